@@ -0,0 +1,469 @@
+// Tests of the bsp tree: what the build and the sorts must keep exact is compared with the
+// plain way to get it, for trees of random meshes built with several options
+// returns a failure when any test fails
+
+#include "Mesh.h"
+#include "VertexBspTree.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// the tree with access to the steps of its build
+class TestBspTree : public VertexBspTree
+{
+public:
+    using VertexBspTree::VertexBspTree;
+
+    // the triangles of separating triangles by a plane, as the positions of their corners, and
+    // the number of vertices the separation created
+    struct Separated
+    {
+        std::vector<glm::vec3> behind, infront, onPlane;
+        std::size_t created = 0;
+    };
+
+    // separate the triangles of the given indices by the plane with the given normal and offset
+    Separated separate(const std::vector<unsigned int> & indices, const glm::vec3 & normal, float offset)
+    {
+        const Triangles triangles = makeTriangles(indices);
+        const std::size_t vertices = getVertices().size();
+        Triangles behind, infront;
+        std::vector<unsigned int> onPlane;
+        separateTriangles(Plane(normal, offset), triangles, gatherPositions(triangles.indices), {}, noGroup, behind, infront, onPlane);
+
+        Separated separated;
+        separated.behind = corners(behind.indices);
+        separated.infront = corners(infront.indices);
+        separated.onPlane = corners(onPlane);
+        separated.created = getVertices().size() - vertices;
+        return separated;
+    }
+
+    // check that the pivot chosen for the given triangles, whose evaluations stop once they
+    // cannot win anymore, is the best pivot of the complete evaluations of all candidates
+    bool sameAsCompletePivot(const std::vector<unsigned int> & indices) const
+    {
+        const Triangles triangles = makeTriangles(indices);
+        const auto positions = gatherPositions(triangles.indices);
+
+        const std::vector<size_type> groups = groupCoplanar(triangles);
+        std::vector<size_type> uniquePlanes;
+        for (size_type t = 0; t < groups.size(); ++t)
+        {
+            if (groups[t] == t) uniquePlanes.push_back(t);
+        }
+        if (uniquePlanes.empty()) uniquePlanes.push_back(0);
+
+        const size_type candidates = candidateCount(uniquePlanes.size());
+        const PivotScore score = pivotScore(indices.size() / 3);
+        const PivotCompare compare{ score };
+        Candidate best;
+        for (size_type j = 0; j < candidates; ++j)
+        {
+            const size_type t = uniquePlanes[candidateTriangle(j, candidates, uniquePlanes.size())];
+            const std::atomic<double> unbounded = std::numeric_limits<double>::infinity();
+            best = compare(best, Candidate(evaluatePivot(triangles.planes[t], triangles, positions, groups, groups[t], score, unbounded), 3 * t));
+        }
+
+        return best.index == choosePivot(triangles, positions, groups, uniquePlanes);
+    }
+
+    // check that the triangles of every subtree are on its side of the planes of the nodes above
+    // it, up to the given distance
+    bool separatedByPlanes(float tolerance) const
+    {
+        std::vector<std::pair<Plane, float>> above;
+        return nodes_.empty() || separatedByPlanes(0, above, tolerance);
+    }
+
+private:
+    // the planes above node n, each with the side of n, -1 behind and 1 in front
+    bool separatedByPlanes(node_index n, std::vector<std::pair<Plane, float>> & above, float tolerance) const
+    {
+        const Node & node = nodes_[n];
+        for (std::size_t i = 0; i < node.count; ++i)
+        {
+            const glm::vec3 & position = getVertices()[nodeIndex(n, i)].Position;
+            for (const auto & [plane, side] : above)
+            {
+                if (side * (glm::dot(std::get<0>(plane), position) - std::get<1>(plane)) < -tolerance) return false;
+            }
+        }
+
+        bool separated = true;
+        for (const auto & [child, side] : { std::make_pair(node.behind, -1.f), std::make_pair(node.infront, 1.f) })
+        {
+            if (child == noNode) continue;
+            above.emplace_back(node.plane, side);
+            separated = separated && separatedByPlanes(child, above, tolerance);
+            above.pop_back();
+        }
+        return separated;
+    }
+
+    Triangles makeTriangles(const std::vector<unsigned int> & indices) const
+    {
+        Triangles triangles{ indices, {} };
+        for (std::size_t t = 0; t < indices.size() / 3; ++t)
+        {
+            triangles.planes.push_back(calculatePlane(indices[3 * t], indices[3 * t + 1], indices[3 * t + 2]));
+        }
+        return triangles;
+    }
+
+    std::vector<glm::vec3> corners(const std::vector<unsigned int> & indices) const
+    {
+        std::vector<glm::vec3> positions;
+        for (const unsigned int i : indices) positions.push_back(getVertices()[i].Position);
+        return positions;
+    }
+};
+
+namespace
+{
+    int g_failures = 0;
+
+    void check(bool passed, const std::string & test, const std::string & tree)
+    {
+        if (!passed)
+        {
+            std::cerr << "FAILED: " << test << " (" << tree << ")" << std::endl;
+            ++g_failures;
+        }
+    }
+
+    Vertex makeVertex(const glm::vec3 & position)
+    {
+        return { position, glm::vec3(0.f, 0.f, 1.f) };
+    }
+
+    // random triangles in a cube, large enough to cross each other, and a grid of coplanar
+    // triangles through the middle
+    void makeMesh(std::mt19937 & random, std::size_t triangles, std::vector<Vertex> & vertices, std::vector<unsigned int> & indices)
+    {
+        std::uniform_real_distribution<float> inCube(-1.f, 1.f);
+        std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
+        for (std::size_t t = 0; t < triangles; ++t)
+        {
+            const glm::vec3 center(inCube(random), inCube(random), inCube(random));
+            for (int v = 0; v < 3; ++v)
+            {
+                indices.push_back(static_cast<unsigned int>(vertices.size()));
+                vertices.push_back(makeVertex(center + glm::vec3(offset(random), offset(random), offset(random))));
+            }
+        }
+
+        for (int x = 0; x < 4; ++x)
+        {
+            for (int y = 0; y < 4; ++y)
+            {
+                const unsigned int first = static_cast<unsigned int>(vertices.size());
+                const glm::vec3 corner(-1.f + 0.5f * x, -1.f + 0.5f * y, 0.1f);
+                vertices.push_back(makeVertex(corner));
+                vertices.push_back(makeVertex(corner + glm::vec3(0.4f, 0.f, 0.f)));
+                vertices.push_back(makeVertex(corner + glm::vec3(0.f, 0.4f, 0.f)));
+                indices.insert(indices.end(), { first, first + 1, first + 2 });
+            }
+        }
+    }
+
+    // separate triangles, one in each cell of a grid, with more vertices than 16 bit offsets reach
+    void makeWideMesh(std::mt19937 & random, std::vector<Vertex> & vertices, std::vector<unsigned int> & indices)
+    {
+        std::uniform_real_distribution<float> inCell(0.1f, 0.9f);
+        for (int x = 0; x < 40; ++x)
+        {
+            for (int y = 0; y < 40; ++y)
+            {
+                for (int z = 0; z < 15; ++z)
+                {
+                    const glm::vec3 cell(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                    for (int v = 0; v < 3; ++v)
+                    {
+                        indices.push_back(static_cast<unsigned int>(vertices.size()));
+                        vertices.push_back(makeVertex((cell + glm::vec3(inCell(random), inCell(random), inCell(random))) / 10.f));
+                    }
+                }
+            }
+        }
+    }
+
+    // points of view around and inside the mesh, following each other like the frames of a flight
+    std::vector<glm::vec3> makeViews(const glm::vec3 & center, float radius)
+    {
+        std::vector<glm::vec3> views;
+        for (int i = 0; i < 48; ++i)
+        {
+            const float angle = 0.13f * float(i);
+            const float distance = radius * ((i < 32) ? 2.5f : 0.3f);
+            views.push_back(center + distance * glm::vec3(std::cos(angle), std::sin(angle), 0.4f * std::sin(0.7f * angle)));
+        }
+        return views;
+    }
+
+    // the positions of the vertices of the sorted triangles, which do not change when the
+    // vertices are renumbered
+    std::vector<glm::vec3> sortedPositions(const VertexBspTree & tree, const glm::vec3 & p)
+    {
+        std::vector<glm::vec3> positions;
+        for (const unsigned int index : tree.sort(p))
+        {
+            positions.push_back(tree.getVertices()[index].Position);
+        }
+        return positions;
+    }
+
+    // pruned pivot evaluations choose the same pivot as complete ones, also with other weights
+    void testPruning(std::mt19937 & random, const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices)
+    {
+        for (const double balance : { 0.0, 0.5 })
+        {
+            bsp::BuildOptions options;
+            options.balanceWeight = balance;
+            const TestBspTree tree(std::vector<Vertex>(vertices), indices, options);
+
+            std::vector<std::size_t> order(indices.size() / 3);
+            for (std::size_t t = 0; t < order.size(); ++t) order[t] = t;
+            bool same = tree.sameAsCompletePivot(indices);
+            for (const std::size_t count : { 3, 20, 100, 300 })
+            {
+                std::shuffle(order.begin(), order.end(), random);
+                std::vector<unsigned int> subset;
+                for (std::size_t k = 0; k < count; ++k)
+                {
+                    subset.insert(subset.end(), indices.begin() + 3 * order[k], indices.begin() + 3 * order[k] + 3);
+                }
+                same = same && tree.sameAsCompletePivot(subset);
+            }
+            check(same, "pruning keeps the pivot", "balance weight " + std::to_string(balance));
+        }
+    }
+
+    // a plane through the shared edge of two triangles creates one vertex on that edge
+    void testSharedCut()
+    {
+        std::vector<Vertex> vertices;
+        for (const glm::vec3 & corner : { glm::vec3(0.f, 0.f, 0.f), glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f, 1.f, 0.f), glm::vec3(0.f, 1.f, 0.f) })
+        {
+            vertices.push_back(makeVertex(corner));
+        }
+        const std::vector<unsigned int> indices{ 0, 1, 2, 0, 2, 3 };
+        TestBspTree tree(std::move(vertices), indices);
+
+        // the plane cuts the edges 0-1 and 2-3 and the diagonal 0-2 that both triangles share
+        const TestBspTree::Separated separated = tree.separate(indices, glm::vec3(1.f, 0.f, 0.f), 0.5f);
+        check(separated.created == 3, "a shared cut edge gets one vertex", "square");
+        check(separated.behind.size() == 9 && separated.infront.size() == 9 && separated.onPlane.empty(), "cut triangles are kept", "square");
+    }
+
+    // separating the triangles in parallel chunks gives the triangles and vertices of separating
+    // them one after the other
+    void testParallelSeparate(std::mt19937 & random)
+    {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        makeMesh(random, 10000, vertices, indices);
+        TestBspTree tree(std::move(vertices), std::vector<unsigned int>{});
+
+        const std::pair<glm::vec3, float> planes[] = { { glm::vec3(0.f, 0.f, 1.f), 0.1f }, { glm::normalize(glm::vec3(1.f, 2.f, 3.f)), 0.2f } };
+        for (const auto & [normal, offset] : planes)
+        {
+            const TestBspTree::Separated chunked = tree.separate(indices, normal, offset);
+
+            TestBspTree::Separated serial;
+            for (std::size_t i = 0; i < indices.size(); i += 3)
+            {
+                const TestBspTree::Separated one = tree.separate({ indices[i], indices[i + 1], indices[i + 2] }, normal, offset);
+                serial.behind.insert(serial.behind.end(), one.behind.begin(), one.behind.end());
+                serial.infront.insert(serial.infront.end(), one.infront.begin(), one.infront.end());
+                serial.onPlane.insert(serial.onPlane.end(), one.onPlane.begin(), one.onPlane.end());
+                serial.created += one.created;
+            }
+
+            const std::string name = "offset " + std::to_string(offset);
+            check(chunked.behind == serial.behind && chunked.infront == serial.infront && chunked.onPlane == serial.onPlane,
+                  "parallel separation keeps the triangles", name);
+            check(chunked.created == serial.created, "parallel separation keeps the vertices", name);
+        }
+    }
+
+    // compare the sorts of the tree that must give the same order as its plain sort
+    void testSorts(const VertexBspTree & tree, const std::vector<glm::vec3> & views, const std::string & name)
+    {
+        std::vector<unsigned int> nodeIndices(tree.indexCount());
+        tree.nodeOrderIndices(nodeIndices.data());
+
+        VertexBspTree::SortState resortState, parallelState, rangesState, visibleState;
+        std::vector<unsigned int> resorted(tree.indexCount()), parallel(tree.indexCount()), visible(tree.indexCount());
+        std::vector<VertexBspTree::DrawRange> ranges;
+        bool sameResort = true, sameParallel = true, sameRanges = true, sameVisible = true, keptVisible = true;
+
+        for (const glm::vec3 & p : views)
+        {
+            const std::vector<unsigned int> sorted = tree.sort(p);
+
+            tree.resort(p, resorted.data(), resortState);
+            sameResort = sameResort && (resorted == sorted);
+
+            tree.sort(p, parallel.data(), parallelState);
+            sameParallel = sameParallel && (parallel == sorted);
+
+            std::vector<unsigned int> drawn;
+            tree.sortRanges(p, ranges, rangesState);
+            for (const VertexBspTree::DrawRange & range : ranges)
+            {
+                drawn.insert(drawn.end(), nodeIndices.begin() + range.first, nodeIndices.begin() + range.first + range.count);
+            }
+            sameRanges = sameRanges && (drawn == sorted);
+
+            // with the whole tree in view it is the plain sort, a narrow view keeps the triangles in that order
+            const glm::mat4 wide = glm::perspective(1.2f, 1.f, 0.01f, 100.f) * glm::lookAt(glm::vec3(0.f, 0.f, 30.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+            const std::size_t wideCount = tree.sortVisible(p, VertexBspTree::makeFrustum(wide), visible.data(), visibleState);
+            sameVisible = sameVisible && (wideCount == sorted.size() && std::equal(sorted.begin(), sorted.end(), visible.begin()));
+
+            const glm::mat4 narrow = glm::perspective(0.3f, 1.f, 0.01f, 100.f) * glm::lookAt(p, glm::vec3(0.f), glm::vec3(0.f, 0.f, 1.f));
+            const std::size_t narrowCount = tree.sortVisible(p, VertexBspTree::makeFrustum(narrow), visible.data(), visibleState);
+            const auto inView = [&tree, &narrow](unsigned int index)
+                {
+                    const glm::vec3 & v = tree.getVertices()[index].Position;
+                    const glm::vec4 c = narrow * glm::vec4(v.x, v.y, v.z, 1.f);
+                    return std::abs(c.x) < c.w && std::abs(c.y) < c.w && std::abs(c.z) < c.w;
+                };
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < sorted.size(); i += 3)
+            {
+                if (kept < narrowCount && std::equal(sorted.begin() + i, sorted.begin() + i + 3, visible.begin() + kept))
+                {
+                    kept += 3;
+                }
+                else if (std::any_of(sorted.begin() + i, sorted.begin() + i + 3, inView))
+                {
+                    keptVisible = false;
+                }
+            }
+            keptVisible = keptVisible && (kept == narrowCount);
+        }
+
+        check(sameResort, "resort equals sort", name);
+        check(sameParallel, "sort with a state equals sort", name);
+        check(sameRanges, "ranges equal sort", name);
+        check(sameVisible, "visible sort of the whole tree equals sort", name);
+        check(keptVisible, "visible sort keeps the triangles in view in the order of sort", name);
+    }
+
+    // narrow the indices of the tree, which must not change the sorted triangles
+    void testNarrow(VertexBspTree & tree, const std::vector<glm::vec3> & views, std::size_t minRegions, const std::string & name)
+    {
+        std::vector<std::vector<glm::vec3>> before;
+        for (const glm::vec3 & p : views)
+        {
+            before.push_back(sortedPositions(tree, p));
+        }
+
+        const std::size_t regions = tree.narrowIndices();
+        check(tree.narrow() && regions >= minRegions, "narrow the indices", name);
+
+        bool same = true;
+        for (std::size_t v = 0; v < views.size(); ++v)
+        {
+            same = same && (sortedPositions(tree, views[v]) == before[v]);
+        }
+        check(same, "narrowed tree sorts the same triangles", name);
+
+        std::vector<unsigned int> nodeIndices(tree.indexCount());
+        tree.nodeOrderIndices(nodeIndices.data());
+        std::vector<unsigned short> nodeOffsets(tree.indexCount());
+        tree.nodeOrderOffsets(nodeOffsets.data());
+
+        VertexBspTree::SortState state;
+        std::vector<VertexBspTree::DrawRange> ranges;
+        bool sameRanges = true;
+        for (const glm::vec3 & p : views)
+        {
+            tree.sortRanges(p, ranges, state);
+            for (const VertexBspTree::DrawRange & range : ranges)
+            {
+                for (std::size_t i = range.first; i < range.first + range.count; ++i)
+                {
+                    sameRanges = sameRanges && (nodeOffsets[i] + range.base == nodeIndices[i]);
+                }
+            }
+        }
+        check(sameRanges, "offsets from the base vertex of the ranges equal the indices", name);
+
+        testSorts(tree, views, name + ", narrow");
+    }
+
+    // trees of the mesh built with each kind of node, and a tree whose vertices need several
+    // base vertices
+    void testTrees(std::mt19937 & random, const std::vector<Vertex> & vertices, const std::vector<unsigned int> & indices)
+    {
+        struct Case
+        {
+            std::string name;
+            bsp::BuildOptions options;
+        };
+        std::vector<Case> cases(5);
+        cases[0].name = "triangles";
+        cases[1].name = "sampled pivots";
+        cases[1].options.pivotSamples = 8;
+        cases[1].options.balanceWeight = 1;
+        cases[2].name = "axis splits";
+        cases[2].options.axisSplitAbove = 64;
+        cases[3].name = "leaf buckets";
+        cases[3].options.leafSize = 4;
+        cases[4].name = "clusters";
+        cases[4].options.clusterSize = 16;
+
+        const std::vector<glm::vec3> views = makeViews(glm::vec3(0.f), 1.f);
+        for (const Case & c : cases)
+        {
+            TestBspTree tree(std::vector<Vertex>(vertices), indices, c.options);
+            check(tree.separatedByPlanes(1e-4f), "subtrees are on their side of the planes above them", c.name);
+            testSorts(tree, views, c.name);
+            testNarrow(tree, views, 1, c.name);
+        }
+
+        std::vector<Vertex> wideVertices;
+        std::vector<unsigned int> wideIndices;
+        makeWideMesh(random, wideVertices, wideIndices);
+        bsp::BuildOptions wideOptions;
+        wideOptions.axisSplitAbove = 256;
+        wideOptions.pivotSamples = 16;
+        VertexBspTree wideTree(std::move(wideVertices), wideIndices, wideOptions);
+        testNarrow(wideTree, makeViews(glm::vec3(2.f, 2.f, 0.75f), 2.f), 2, "wide mesh");
+    }
+}
+
+//--------------------------------------------------------------------------
+int main()
+{
+    std::mt19937 random(20240611);
+
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    makeMesh(random, 600, vertices, indices);
+
+    testPruning(random, vertices, indices);
+    testSharedCut();
+    testParallelSeparate(random);
+    testTrees(random, vertices, indices);
+
+    if (g_failures > 0)
+    {
+        std::cerr << g_failures << " tests failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "All tests passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -33,4 +33,32 @@ unsigned int* CreateMappedBufferData(GLuint vboId, GLuint eboId, const std::vect
     glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, bufferSize, 0, flags);
     return (unsigned int*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, bufferSize, flags);
 }
+
+//--------------------------------------------------------------------------
+void CreateIndexBufferData(GLuint vboId, GLuint eboId, const std::vector<unsigned int>& indices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboId);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLubyte*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLubyte*)offsetof(Vertex, Normal));
+}
+
+//--------------------------------------------------------------------------
+void CreateIndexBufferData(GLuint vboId, GLuint eboId, const std::vector<unsigned short>& indices)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboId);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLubyte*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLubyte*)offsetof(Vertex, Normal));
+}
 #endif
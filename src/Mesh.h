@@ -17,6 +17,8 @@ struct Vertex {
 #ifndef NO_OPENGL
 void CreateBufferData(GLuint vboId, GLuint eboId, const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
 unsigned int* CreateMappedBufferData(GLuint vboId, GLuint eboId, const std::vector<Vertex>& vertices, unsigned int indexSize);
+void CreateIndexBufferData(GLuint vboId, GLuint eboId, const std::vector<unsigned int>& indices);
+void CreateIndexBufferData(GLuint vboId, GLuint eboId, const std::vector<unsigned short>& indices);
 #endif
 
 inline Vertex operator*(const Vertex& v, float f)
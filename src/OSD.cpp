@@ -315,6 +315,9 @@ void DrawOsd(char mode, float opacity, int numPasses, float fps)
 		case BSP_MODE:
 	    	buf = "Binary Space Partitioning";
             break;
+		case BSP_RANGES_MODE:
+			buf = "Binary Space Partitioning Ranges";
+			break;
         default:
             buf = "Unknown mode";
 	}
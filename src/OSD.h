@@ -18,7 +18,8 @@ enum {
 	F2B_PEELING_MODE,
 	WEIGHTED_AVERAGE_MODE,
 	WEIGHTED_SUM_MODE,
-	BSP_MODE
+	BSP_MODE,
+	BSP_RANGES_MODE
 };
 
 #if 0
@@ -8,7 +8,15 @@ VertexPartBspTree::VertexPartBspTree() : VertexBspTree()
 }
 
 //--------------------------------------------------------------------------
-VertexPartBspTree::VertexPartBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices) : VertexBspTree(std::move(vertices), indices)
+VertexPartBspTree::VertexPartBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options)
+    : VertexBspTree(std::move(vertices), faces, options)
+{
+}
+
+//--------------------------------------------------------------------------
+VertexPartBspTree::VertexPartBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options,
+                                     const std::string & checkpointFilename)
+    : VertexBspTree(std::move(vertices), faces, options, checkpointFilename)
 {
 }
 
@@ -36,51 +44,56 @@ std::shared_ptr<VertexPartBspTree> VertexPartBspTree::merge(const VertexPartBspT
     const Plane plane{ std::make_tuple(normal, offset) };
 
     std::shared_ptr tree{ std::make_shared<VertexPartBspTree>() };
-    tree->root_ = std::make_unique<Node>();
-    tree->root_->plane = plane;
+    tree->addNode(Slot{}, plane, {});
 
+    const node_index lhsRoot{ lhs.nodes_.empty() ? noNode : 0 };
+    const node_index rhsRoot{ rhs.nodes_.empty() ? noNode : 0 };
     if (glm::dot(centroidR, centroidL) < 0)
     {
-        tree->root_->behind = tree->copy(lhs.root_.get(), lhs.vertices_);
-        tree->root_->infront = tree->copy(rhs.root_.get(), rhs.vertices_);
+        tree->copy(lhs, lhsRoot, Slot{}.child(0, false));
+        tree->copy(rhs, rhsRoot, Slot{}.child(0, true));
     }
     else
     {
-        tree->root_->behind = tree->copy(rhs.root_.get(), rhs.vertices_);
-        tree->root_->infront = tree->copy(lhs.root_.get(), lhs.vertices_);
+        tree->copy(rhs, rhsRoot, Slot{}.child(0, false));
+        tree->copy(lhs, lhsRoot, Slot{}.child(0, true));
     }
+    tree->computeBounds();
 
     return tree;
 }
 
 //--------------------------------------------------------------------------
-std::unique_ptr<VertexPartBspTree::Node> VertexPartBspTree::copy(const Node * n, const std::vector<Vertex> & v)
+void VertexPartBspTree::copy(const VertexPartBspTree & from, node_index n, const Slot & slot)
 {
-    if (n)
+    if (n != noNode)
     {
-        std::unique_ptr node{ std::make_unique<Node>() };
-        node->plane = n->plane;
+        const Node & source{ from.nodes_[n] };
+
+        std::vector<unsigned int> triangles;
+        triangles.reserve(source.count);
 
         std::unordered_map<unsigned int, unsigned int> mergedIndices;
-        for (unsigned int index : n->triangles)
+        for (std::uint32_t i = 0; i < source.count; ++i)
         {
+            const unsigned int index{ from.nodeIndex(n, i) };
             if (mergedIndices.contains(index))
             {
-                node->triangles.push_back(mergedIndices[index]);
+                triangles.push_back(mergedIndices[index]);
             }
             else
             {
                 mergedIndices.emplace(index, static_cast<unsigned int>(vertices_.size()));
-                node->triangles.push_back(vertices_.size());
-                vertices_.push_back(v[index]);
+                triangles.push_back(vertices_.size());
+                vertices_.push_back(from.vertices_[index]);
             }
         }
 
-        node->behind = copy(n->behind.get(), v);
-        node->infront = copy(n->infront.get(), v);
+        const std::uint32_t leaf{ from.leafOf(n) };
+        const std::uint8_t * orders{ (leaf != notLeaf && leaf != noOrders) ? from.clusterOrders_.data() + leaf : nullptr };
+        const node_index node{ addNode(slot, source.plane, triangles, leaf != notLeaf, orders) };
 
-        return node;
+        copy(from, source.behind, slot.child(node, false));
+        copy(from, source.infront, slot.child(node, true));
     }
-
-    return std::unique_ptr<Node>();
 }
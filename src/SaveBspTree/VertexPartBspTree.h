@@ -6,13 +6,15 @@ class VertexPartBspTree : public VertexBspTree
 {
 public:
     VertexPartBspTree();
-    VertexPartBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices);
+    VertexPartBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options = {});
+    VertexPartBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options,
+                      const std::string & checkpointFilename);
 
     // lhs as behind, rhs as infront if lhs plane normal is behind rhs plane normal
     // otherwise rhs as behind and lhs as infront
     static std::shared_ptr<VertexPartBspTree> merge(const VertexPartBspTree & lhs, const VertexPartBspTree & rhs);
 
 protected:
-    // copy node into the tree
-    std::unique_ptr<Node> copy(const Node * n, const std::vector<Vertex> & v);
+    // copy node n of the tree from with its children into the tree at slot
+    void copy(const VertexPartBspTree & from, node_index n, const Slot & slot);
 };
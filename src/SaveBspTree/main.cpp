@@ -1,5 +1,17 @@
 // Utility to build a bsp tree into a file name
 // argument: the Object file to build
+// options: --samples K to score at most K candidate pivots per node
+//          --sample-ratio R to score at most this fraction of the triangles of a node
+//          --checkpoint-interval S to save a checkpoint every S seconds (0 to disable)
+//          --resume to continue the build from the last checkpoint
+//          --leaf-size N, --leaf-depth D, --leaf-after S to stop splitting subtrees into leaf buckets
+//          --axis-split N to split subtrees of more than N triangles with axis aligned planes
+//          --cluster-size N to build the tree over clusters of at most N triangles
+//          --split-weight W, --balance-weight W, --coplanar-weight W to tune the score of the pivots
+//          --snap-tolerance T, --sliver-ratio R to avoid tiny splits of triangles
+//          --progress S to report the progress every S seconds (0 to disable)
+//          --statistics to write the statistics of the build next to the binary file
+//          --narrow-indices to store the indices of the saved tree as 16 bit offsets where possible
 // write a binary file of the same name then the obj file in the same location
 
 #include "Mesh.h"
@@ -11,18 +23,175 @@
 
 #include <filesystem>
 #include <iostream>
+#include <string>
+
+int usage()
+{
+    std::cerr << "Usage:" << std::endl;
+    std::cerr << "build-save-bsp-tree [options] model.obj" << std::endl;
+    std::cerr << "If the model is big, build it with parts like model-1.obj, model-2.obj..." << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  --samples K        score at most K candidate pivots per node (default all)" << std::endl;
+    std::cerr << "  --sample-ratio R   score at most R * triangles candidate pivots per node, 0 < R <= 1 (default 1)" << std::endl;
+    std::cerr << "  --checkpoint-interval S   save a model.checkpoint file every S seconds, 0 to disable (default 600)" << std::endl;
+    std::cerr << "  --resume           continue the build from model.checkpoint when it exists" << std::endl;
+    std::cerr << "  --leaf-size N      keep subtrees of at most N triangles as leaf buckets sorted at runtime (default 0, none)" << std::endl;
+    std::cerr << "  --leaf-depth D     keep subtrees from depth D as leaf buckets (default 0, no limit)" << std::endl;
+    std::cerr << "  --leaf-after S     keep all subtrees left after S seconds of build as leaf buckets (default 0, no limit)" << std::endl;
+    std::cerr << "  --axis-split N     split subtrees of more than N triangles at the median along their longest axis (default 0, never)" << std::endl;
+    std::cerr << "  --cluster-size N   build the tree over clusters of at most N triangles with precomputed orders, N <= 256 (default 0, none)" << std::endl;
+    std::cerr << "  --split-weight W   weight of the triangles added by splits in the score of a pivot (default 1)" << std::endl;
+    std::cerr << "  --balance-weight W weight of the difference between both sides in the score of a pivot (default 0)" << std::endl;
+    std::cerr << "  --coplanar-weight W  weight of the triangles on the plane in the score of a pivot (default 1)" << std::endl;
+    std::cerr << "  --snap-tolerance T count vertices closer to a plane than T * size of the model as on the plane (default 0)" << std::endl;
+    std::cerr << "  --sliver-ratio R   keep triangles whole instead of splitting off less than R of their area, 0 <= R < 0.5 (default 0)" << std::endl;
+    std::cerr << "  --progress S       report the progress of the build every S seconds, 0 to disable (default 60)" << std::endl;
+    std::cerr << "  --statistics       write the statistics of the build into model.statistics.json" << std::endl;
+    std::cerr << "  --narrow-indices   store the indices of the nodes as 16 bit offsets from a base vertex in model.bin where possible" << std::endl;
+    return EXIT_FAILURE;
+}
 
 int main(int argc, char** argv)
 {
-    if (argc != 2)
+    bsp::BuildOptions options;
+    options.checkpointInterval = 600;
+    options.progressInterval = 60;
+    options.progress = [](const bsp::BuildStatistics & statistics)
     {
-        std::cerr << "Usage:" << std::endl;
-        std::cerr << "build-save-bsp-tree model.obj" << std::endl;
-        std::cerr << "If the model is big, build it with parts like model-1.obj, model-2.obj..." << std::endl;
-        return EXIT_FAILURE;
+        const bsp::DepthStatistics total{ statistics.total() };
+        std::cout << "Progress " << static_cast<int>(100 * statistics.progress()) << "%"
+                  << ", " << total.nodes << " nodes"
+                  << ", " << statistics.remainingSubtrees.size() << " subtrees left"
+                  << ", largest " << (statistics.remainingSubtrees.empty() ? 0 : *statistics.remainingSubtrees.rbegin()) << " triangles"
+                  << ", " << static_cast<int>(statistics.seconds) << " s" << std::endl;
+    };
+    bool resume = false;
+    bool saveStatistics = false;
+    bool narrowIndices = false;
+    std::string modelFilename;
+
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument{ argv[i] };
+            const bool hasValue{ i + 1 < argc };
+            if (argument == "--samples" && hasValue)
+            {
+                options.pivotSamples = std::stoul(argv[++i]);
+            }
+            else if (argument == "--sample-ratio" && hasValue)
+            {
+                options.pivotSampleRatio = std::stod(argv[++i]);
+                if (options.pivotSampleRatio <= 0 || options.pivotSampleRatio > 1)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--checkpoint-interval" && hasValue)
+            {
+                options.checkpointInterval = std::stod(argv[++i]);
+            }
+            else if (argument == "--leaf-size" && hasValue)
+            {
+                options.leafSize = std::stoul(argv[++i]);
+            }
+            else if (argument == "--leaf-depth" && hasValue)
+            {
+                options.leafDepth = std::stoul(argv[++i]);
+            }
+            else if (argument == "--leaf-after" && hasValue)
+            {
+                options.leafAfter = std::stod(argv[++i]);
+            }
+            else if (argument == "--axis-split" && hasValue)
+            {
+                options.axisSplitAbove = std::stoul(argv[++i]);
+            }
+            else if (argument == "--cluster-size" && hasValue)
+            {
+                options.clusterSize = std::stoul(argv[++i]);
+                if (options.clusterSize > bsp::maxClusterSize)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--split-weight" && hasValue)
+            {
+                options.splitWeight = std::stod(argv[++i]);
+                if (options.splitWeight < 0)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--balance-weight" && hasValue)
+            {
+                options.balanceWeight = std::stod(argv[++i]);
+                if (options.balanceWeight < 0)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--coplanar-weight" && hasValue)
+            {
+                options.coplanarWeight = std::stod(argv[++i]);
+                if (options.coplanarWeight < 0)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--snap-tolerance" && hasValue)
+            {
+                options.snapTolerance = std::stod(argv[++i]);
+                if (options.snapTolerance < 0)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--sliver-ratio" && hasValue)
+            {
+                options.sliverRatio = std::stod(argv[++i]);
+                if (options.sliverRatio < 0 || options.sliverRatio >= 0.5)
+                {
+                    return usage();
+                }
+            }
+            else if (argument == "--progress" && hasValue)
+            {
+                options.progressInterval = std::stod(argv[++i]);
+            }
+            else if (argument == "--statistics")
+            {
+                saveStatistics = true;
+            }
+            else if (argument == "--narrow-indices")
+            {
+                narrowIndices = true;
+            }
+            else if (argument == "--resume")
+            {
+                resume = true;
+            }
+            else if (modelFilename.empty() && !argument.starts_with("--"))
+            {
+                modelFilename = argument;
+            }
+            else
+            {
+                return usage();
+            }
+        }
+    }
+    catch (const std::exception &)
+    {
+        return usage();
+    }
+
+    if (modelFilename.empty())
+    {
+        return usage();
     }
 
-    const std::string modelFilename{ argv[1] };
     std::cout << "Load and build BSP tree for " << modelFilename << std::endl;
 
     std::vector<std::string> filenameToLoad;
@@ -54,9 +223,13 @@ int main(int argc, char** argv)
         std::filesystem::path pathPart(filename);
         pathPart.replace_extension("bin");
         const std::string bspPartFilename{ pathPart.string() };
+        pathPart.replace_extension("checkpoint");
+        const std::string checkpointFilename{ pathPart.string() };
+        pathPart.replace_extension("statistics.json");
+        const std::string statisticsFilename{ pathPart.string() };
 
         std::shared_ptr<VertexPartBspTree> bspTree;
-        if (std::filesystem::exists(pathPart))
+        if (std::filesystem::exists(bspPartFilename))
         {
             std::cout << "Loading " << bspPartFilename << std::endl;
 
@@ -67,6 +240,33 @@ int main(int argc, char** argv)
                 return EXIT_FAILURE;
             }
         }
+        else if (resume && std::filesystem::exists(checkpointFilename))
+        {
+            std::cout << "Resuming " << checkpointFilename << std::endl;
+
+            bspTree = std::make_shared<VertexPartBspTree>();
+            if (!bspTree->resume(checkpointFilename, options))
+            {
+                std::cerr << "Error resuming model " << filename << " from " << checkpointFilename << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            std::cout << "Saving " << bspPartFilename << std::endl;
+
+            if (!bspTree->save(bspPartFilename))
+            {
+                std::cerr << "Error saving model " << filename << " to " << bspPartFilename << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            std::filesystem::remove(checkpointFilename);
+
+            if (saveStatistics && !bspTree->saveStatistics(statisticsFilename))
+            {
+                std::cerr << "Error saving statistics of model " << filename << " to " << statisticsFilename << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
         else
         {
             std::cout << "Loading " << filename << std::endl;
@@ -118,19 +318,7 @@ int main(int argc, char** argv)
                 vertices.push_back(vertex);
             }
 
-            std::vector<unsigned int> indices;
-            indices.reserve(model->mNumFaces * 3);
-
-            for (unsigned int i = 0; i < model->mNumFaces; ++i)
-            {
-                const aiFace &face = model->mFaces[i];
-                for (unsigned int j = 0; j < 3 && j < face.mNumIndices; j++)
-                {
-                    indices.push_back(face.mIndices[j]);
-                }
-            }
-
-            bspTree = std::make_shared<VertexPartBspTree>(std::move(vertices), indices);
+            bspTree = std::make_shared<VertexPartBspTree>(std::move(vertices), MeshFaces{ model }, options, checkpointFilename);
 
             std::cout << "Saving " << bspPartFilename << std::endl;
 
@@ -139,6 +327,14 @@ int main(int argc, char** argv)
                 std::cerr << "Error saving model " << filename << " to " << bspPartFilename << std::endl;
                 return EXIT_FAILURE;
             }
+
+            std::filesystem::remove(checkpointFilename);
+
+            if (saveStatistics && !bspTree->saveStatistics(statisticsFilename))
+            {
+                std::cerr << "Error saving statistics of model " << filename << " to " << statisticsFilename << std::endl;
+                return EXIT_FAILURE;
+            }
         }
 
         const std::vector<Vertex>& bspVertices = bspTree->getVertices();
@@ -172,6 +368,12 @@ int main(int argc, char** argv)
         bspTreeToSave = bspTrees.front();
     }
 
+    if (narrowIndices)
+    {
+        const std::size_t narrowRegions = bspTreeToSave->narrowIndices();
+        std::cout << narrowRegions << " regions of narrow nodes" << std::endl;
+    }
+
     if (!bspTreeToSave->save(bspFilename))
     {
         std::cerr << "Error saving model " << modelFilename << " to " << bspFilename << std::endl;
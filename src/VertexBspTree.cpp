@@ -1,25 +1,111 @@
 #include "VertexBspTree.hpp"
 
+#include <glm/gtc/matrix_access.hpp>
+
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <filesystem>
+
+// a node in the file is present, absent, a subtree left to build in a checkpoint
+// or a leaf bucket, that has no child nodes, narrow nodes store their indices as
+// 16 bit offsets from the base vertex of their region, clusters are leaf buckets
+// with the orders of their triangles
+enum NodeTag : std::uint8_t
+{
+    NoNode = 0,
+    HasNode = 1,
+    PendingNode = 2,
+    LeafNode = 3,
+    NarrowNode = 4,
+    NarrowLeafNode = 5,
+    ClusterNode = 6,
+    NarrowClusterNode = 7
+};
+
+inline void writeNode(std::ofstream &ofs, const VertexBspTree &tree, const VertexBspTree::Slot &slot, VertexBspTree::node_index node, const VertexBspTree::PendingIds *pendingIds = nullptr) noexcept;
+inline void readNode(std::ifstream &ifs, VertexBspTree &tree, const VertexBspTree::Slot &slot, VertexBspTree::PendingSlots *pendingSlots = nullptr) noexcept;
+
+//--------------------------------------------------------------------------
+VertexBspTree::VertexBspTree() : VertexBspTreeType(bsp::BuildOptions())
+{
+}
+
+//--------------------------------------------------------------------------
+VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices, const bsp::BuildOptions & options)
+    : VertexBspTreeType(std::move(vertices), indices, options)
+{
+}
+
+//--------------------------------------------------------------------------
+VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const bsp::BuildOptions & options)
+    : VertexBspTreeType(std::move(vertices), options)
+{
+}
+
+//--------------------------------------------------------------------------
+VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices, const bsp::BuildOptions & options,
+                             const std::string & checkpointFilename)
+    : VertexBspTreeType(options)
+{
+    vertices_ = std::move(vertices);
+    build(indices, [checkpointFilename](Checkpoint &&checkpoint) { saveCheckpoint(checkpointFilename, std::move(checkpoint)); });
+}
 
-inline void writeNode(std::ofstream &ofs, const std::unique_ptr<VertexBspTreeType::Node> &node) noexcept;
-inline std::unique_ptr<VertexBspTreeType::Node> readNode(std::ifstream &ifs) noexcept;
+//--------------------------------------------------------------------------
+bool MeshFaces::triangulated() const noexcept
+{
+    return std::all_of(mesh->mFaces, mesh->mFaces + mesh->mNumFaces, [](const aiFace &face) { return face.mNumIndices == 3; });
+}
 
 //--------------------------------------------------------------------------
-VertexBspTree::VertexBspTree() : VertexBspTreeType(std::vector<Vertex>())
+std::vector<unsigned int> MeshFaces::triangleIndices() const
 {
+    std::vector<unsigned int> indices;
+    indices.reserve(mesh->mNumFaces * 3);
+
+    for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+    {
+        const aiFace &face = mesh->mFaces[i];
+        for (unsigned int j = 2; j < face.mNumIndices; j++)
+        {
+            indices.insert(indices.end(), { face.mIndices[0], face.mIndices[j - 1], face.mIndices[j] });
+        }
+    }
+
+    return indices;
 }
 
 //--------------------------------------------------------------------------
-VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices)
-    : VertexBspTreeType(std::move(vertices), indices)
+VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options)
+    : VertexBspTreeType(options)
 {
+    vertices_ = std::move(vertices);
+    if (faces.triangulated())
+    {
+        build(faces);
+    }
+    else
+    {
+        build(faces.triangleIndices());
+    }
 }
 
 //--------------------------------------------------------------------------
-VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices) : VertexBspTreeType(std::move(vertices))
+VertexBspTree::VertexBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options,
+                             const std::string & checkpointFilename)
+    : VertexBspTreeType(options)
 {
+    vertices_ = std::move(vertices);
+    const auto checkpoint = [checkpointFilename](Checkpoint &&checkpoint) { saveCheckpoint(checkpointFilename, std::move(checkpoint)); };
+    if (faces.triangulated())
+    {
+        build(faces, checkpoint);
+    }
+    else
+    {
+        build(faces.triangleIndices(), checkpoint);
+    }
 }
 
 //--------------------------------------------------------------------------
@@ -38,7 +124,30 @@ bool VertexBspTree::save(const std::string &filename) const noexcept
     ofs.write(reinterpret_cast<const char*>(vertices_.data()), verticesSize * sizeof(Vertex));
 
     // Write BSP-tree
-    writeNode(ofs, root_);
+    writeNode(ofs, *this, Slot{}, nodes_.empty() ? noNode : 0);
+
+    // Write bounding boxes of the subtrees, in the order the nodes were written
+    size_t boundsSize = nodes_.size();
+    ofs.write(reinterpret_cast<const char*>(&boundsSize), sizeof(boundsSize));
+    std::vector<node_index> stack;
+    if (!nodes_.empty()) stack.push_back(0);
+    while (!stack.empty())
+    {
+        const node_index node = stack.back();
+        const Node &n = nodes_[node];
+        stack.pop_back();
+
+        ofs.write(reinterpret_cast<const char*>(&bounds_[node].lower), sizeof(point_type));
+        ofs.write(reinterpret_cast<const char*>(&bounds_[node].upper), sizeof(point_type));
+
+        if (n.infront != noNode) stack.push_back(n.infront);
+        if (n.behind != noNode) stack.push_back(n.behind);
+    }
+
+    // Write regions of the nodes of a narrow tree, whose nodes are in the order they were written
+    size_t regionsSize = regions_.size();
+    ofs.write(reinterpret_cast<const char*>(&regionsSize), sizeof(regionsSize));
+    ofs.write(reinterpret_cast<const char*>(regions_.data()), regionsSize * sizeof(Region));
 
     ofs.close();
 
@@ -62,72 +171,379 @@ bool VertexBspTree::load(const std::string &filename) noexcept
     ifs.read(reinterpret_cast<char*>(vertices_.data()), verticesSize * sizeof(Vertex));
 
     // Read BSP-tree
-    root_ = readNode(ifs);
+    nodes_.clear();
+    triangles_.clear();
+    narrowTriangles_.clear();
+    regions_.clear();
+    leaves_.clear();
+    bounds_.clear();
+    clusterOrders_.clear();
+    readNode(ifs, *this, Slot{});
+
+    // Read bounding boxes of the subtrees, files saved without them get them computed
+    size_t boundsSize = 0;
+    ifs.read(reinterpret_cast<char*>(&boundsSize), sizeof(boundsSize));
+    const bool hasBounds = (ifs && boundsSize == nodes_.size());
+    if (hasBounds)
+    {
+        bounds_.resize(nodes_.size());
+        for (Bounds &b : bounds_)
+        {
+            ifs.read(reinterpret_cast<char*>(&b.lower), sizeof(point_type));
+            ifs.read(reinterpret_cast<char*>(&b.upper), sizeof(point_type));
+        }
+    }
+
+    // Read regions of the nodes of a narrow tree
+    size_t regionsSize = 0;
+    ifs.read(reinterpret_cast<char*>(&regionsSize), sizeof(regionsSize));
+    if (ifs)
+    {
+        regions_.resize(regionsSize);
+        ifs.read(reinterpret_cast<char*>(regions_.data()), regionsSize * sizeof(Region));
+    }
+    if (!narrowTriangles_.empty() && (!ifs || regions_.empty() || !triangles_.empty()))
+    {
+        std::cerr << "Invalid narrow BSP tree: " << filename << std::endl;
+        return false;
+    }
+
+    if (!hasBounds)
+    {
+        computeBounds();
+    }
 
     ifs.close();
 
     return true;
 }
 
+//--------------------------------------------------------------------------
+bool VertexBspTree::saveStatistics(const std::string &filename) const noexcept
+{
+    std::ofstream ofs(filename);
+    if (!ofs)
+    {
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    const auto writeDepth = [&ofs](const bsp::DepthStatistics &depth)
+    {
+        ofs << "\"nodes\": " << depth.nodes
+            << ", \"leaves\": " << depth.leaves
+            << ", \"triangles\": " << depth.triangles
+            << ", \"splitTriangles\": " << depth.splitTriangles
+            << ", \"addedVertices\": " << depth.addedVertices
+            << ", \"pivotSeconds\": " << depth.pivotSeconds
+            << ", \"partitionSeconds\": " << depth.partitionSeconds;
+    };
+
+    // Write totals
+    ofs << "{" << std::endl;
+    ofs << "  \"seconds\": " << statistics_.seconds << "," << std::endl;
+    ofs << "  \"vertices\": " << vertices_.size() << "," << std::endl;
+    ofs << "  \"placedTriangles\": " << statistics_.placedTriangles << "," << std::endl;
+    ofs << "  \"total\": { ";
+    writeDepth(statistics_.total());
+    ofs << " }," << std::endl;
+
+    // Write statistics of each depth
+    ofs << "  \"depths\": [" << std::endl;
+    for (std::size_t depth = 0; depth < statistics_.depths.size(); ++depth)
+    {
+        ofs << "    { \"depth\": " << depth << ", ";
+        writeDepth(statistics_.depths[depth]);
+        ofs << " }" << (depth + 1 < statistics_.depths.size() ? "," : "") << std::endl;
+    }
+    ofs << "  ]" << std::endl;
+    ofs << "}" << std::endl;
+
+    ofs.close();
+
+    return true;
+}
 
 //--------------------------------------------------------------------------
-inline void writeNode(std::ofstream &ofs, const std::unique_ptr<VertexBspTreeType::Node> &node) noexcept
+bool VertexBspTree::saveCheckpoint(const std::string &filename, Checkpoint &&checkpoint) noexcept
 {
-    if (node)
+    // write into a temporary file first, so an interruption while writing keeps the previous checkpoint
+    const std::string temporaryFilename{ filename + ".tmp" };
+    std::ofstream ofs(temporaryFilename, std::ios::binary);
+    if (!ofs)
     {
+        std::cerr << "Failed to open file for writing: " << temporaryFilename << std::endl;
+        return false;
+    }
+
+    // the nodes built so far as a tree of their own, written like the nodes of any tree
+    VertexBspTree tree;
+    tree.vertices_ = std::move(checkpoint.vertices);
+    tree.nodes_ = std::move(checkpoint.nodes);
+    tree.triangles_ = std::move(checkpoint.triangles);
+    tree.leaves_ = std::move(checkpoint.leaves);
+    tree.clusterOrders_ = std::move(checkpoint.clusterOrders);
+
+    // Write vertices
+    size_t verticesSize = tree.vertices_.size();
+    ofs.write(reinterpret_cast<const char*>(&verticesSize), sizeof(verticesSize));
+    ofs.write(reinterpret_cast<const char*>(tree.vertices_.data()), verticesSize * sizeof(Vertex));
+
+    // Write BSP-tree built so far, with the places of the subtrees left to build
+    PendingIds pendingIds;
+    for (const auto &[slot, triangles] : checkpoint.unbuilt)
+    {
+        pendingIds.emplace(slot, pendingIds.size());
+    }
+
+    size_t pendingSize = checkpoint.unbuilt.size();
+    ofs.write(reinterpret_cast<const char*>(&pendingSize), sizeof(pendingSize));
+    writeNode(ofs, tree, Slot{}, tree.nodes_.empty() ? noNode : 0, &pendingIds);
+
+    // Write subtrees left to build, the ones being built are started again on resume
+    for (const auto &[slot, triangles] : checkpoint.unbuilt)
+    {
+        size_t indicesSize = triangles.indices.size();
+        ofs.write(reinterpret_cast<const char*>(&indicesSize), sizeof(indicesSize));
+        ofs.write(reinterpret_cast<const char*>(triangles.indices.data()), indicesSize * sizeof(unsigned int));
+
+        for (const Plane &plane : triangles.planes)
+        {
+            ofs.write(reinterpret_cast<const char*>(&std::get<0>(plane)), sizeof(point_type));
+            ofs.write(reinterpret_cast<const char*>(&std::get<1>(plane)), sizeof(coord_type));
+        }
+    }
+
+    ofs.close();
+    if (!ofs)
+    {
+        std::cerr << "Failed to write checkpoint: " << temporaryFilename << std::endl;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryFilename, filename, error);
+    if (error)
+    {
+        std::cerr << "Failed to replace checkpoint " << filename << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    std::cout << "Checkpoint " << filename << ", " << checkpoint.unbuilt.size() << " pending subtrees" << std::endl;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------
+bool VertexBspTree::resume(const std::string &checkpointFilename, const bsp::BuildOptions & options)
+{
+    std::ifstream ifs(checkpointFilename, std::ios::binary);
+    if (!ifs)
+    {
+        std::cerr << "Failed to open file for reading: " << checkpointFilename << std::endl;
+        return false;
+    }
+
+    // Read vertices
+    size_t verticesSize;
+    ifs.read(reinterpret_cast<char*>(&verticesSize), sizeof(verticesSize));
+    vertices_.resize(verticesSize);
+    ifs.read(reinterpret_cast<char*>(vertices_.data()), verticesSize * sizeof(Vertex));
+
+    // Read BSP-tree built so far
+    size_t pendingSize;
+    ifs.read(reinterpret_cast<char*>(&pendingSize), sizeof(pendingSize));
+    PendingSlots pendingSlots(pendingSize);
+    nodes_.clear();
+    triangles_.clear();
+    narrowTriangles_.clear();
+    regions_.clear();
+    leaves_.clear();
+    bounds_.clear();
+    clusterOrders_.clear();
+    readNode(ifs, *this, Slot{}, &pendingSlots);
+
+    // Read pending subtrees
+    pending_.clear();
+    for (const std::optional<Slot> &slot : pendingSlots)
+    {
+        PendingTree pending{ slot.value_or(Slot{}), {} };
+
+        size_t indicesSize;
+        ifs.read(reinterpret_cast<char*>(&indicesSize), sizeof(indicesSize));
+        pending.triangles.indices.resize(indicesSize);
+        ifs.read(reinterpret_cast<char*>(pending.triangles.indices.data()), indicesSize * sizeof(unsigned int));
+
+        pending.triangles.planes.resize(indicesSize / 3);
+        for (Plane &plane : pending.triangles.planes)
+        {
+            ifs.read(reinterpret_cast<char*>(&std::get<0>(plane)), sizeof(point_type));
+            ifs.read(reinterpret_cast<char*>(&std::get<1>(plane)), sizeof(coord_type));
+        }
+
+        pending_.push_back(std::move(pending));
+    }
+
+    if (!ifs || std::ranges::find(pendingSlots, std::optional<Slot>{}) != pendingSlots.end())
+    {
+        std::cerr << "Invalid checkpoint: " << checkpointFilename << std::endl;
+        pending_.clear();
+        return false;
+    }
+
+    ifs.close();
+
+    std::cout << "Resume " << checkpointFilename << ", " << pending_.size() << " pending subtrees" << std::endl;
+
+    options_ = options;
+    buildPending([checkpointFilename](Checkpoint &&checkpoint) { saveCheckpoint(checkpointFilename, std::move(checkpoint)); });
+
+    return true;
+}
+
+//--------------------------------------------------------------------------
+VertexBspTree::Frustum VertexBspTree::makeFrustum(const glm::mat4 & modelViewProjection)
+{
+    // a point is visible when its clip coordinates x, y and z are between -w and w, each
+    // of these 6 conditions is a plane made of the last row of the matrix and another row
+    const glm::vec4 x{ glm::row(modelViewProjection, 0) };
+    const glm::vec4 y{ glm::row(modelViewProjection, 1) };
+    const glm::vec4 z{ glm::row(modelViewProjection, 2) };
+    const glm::vec4 w{ glm::row(modelViewProjection, 3) };
+
+    const auto plane = [](const glm::vec4 & p) { return Plane{ glm::vec3(p), -p.w }; };
+    return Frustum{ plane(w + x), plane(w - x), plane(w + y), plane(w - y), plane(w + z), plane(w - z) };
+}
+
+//--------------------------------------------------------------------------
+inline void writeNode(std::ofstream &ofs, const VertexBspTree &tree, const VertexBspTree::Slot &slot, VertexBspTree::node_index node, const VertexBspTree::PendingIds *pendingIds) noexcept
+{
+    if (node != VertexBspTree::noNode)
+    {
+        const VertexBspTree::Node &n = tree.nodes_[node];
+
         // Write presence of node
-        bool hasNode = true;
-        ofs.write(reinterpret_cast<const char*>(&hasNode), sizeof(hasNode));
+        const bool narrow = !tree.regions_.empty();
+        const std::uint32_t leaf = tree.leafOf(node);
+        NodeTag tag = narrow ? NarrowNode : HasNode;
+        if (leaf != VertexBspTree::notLeaf && leaf != VertexBspTree::noOrders)
+        {
+            tag = narrow ? NarrowClusterNode : ClusterNode;
+        }
+        else if (leaf == VertexBspTree::noOrders)
+        {
+            tag = narrow ? NarrowLeafNode : LeafNode;
+        }
+        ofs.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
 
         // Write plane
-        ofs.write(reinterpret_cast<const char*>(&std::get<0>(node->plane)), sizeof(VertexBspTreeType::point_type));
-        ofs.write(reinterpret_cast<const char*>(&std::get<1>(node->plane)), sizeof(VertexBspTreeType::coord_type));
+        ofs.write(reinterpret_cast<const char*>(&std::get<0>(n.plane)), sizeof(VertexBspTreeType::point_type));
+        ofs.write(reinterpret_cast<const char*>(&std::get<1>(n.plane)), sizeof(VertexBspTreeType::coord_type));
 
         // Write triangles
-        size_t trianglesSize = node->triangles.size();
+        size_t trianglesSize = n.count;
         ofs.write(reinterpret_cast<const char*>(&trianglesSize), sizeof(trianglesSize));
-        ofs.write(reinterpret_cast<const char*>(node->triangles.data()), trianglesSize * sizeof(unsigned int));
+        if (narrow)
+        {
+            ofs.write(reinterpret_cast<const char*>(tree.narrowTriangles_.data() + n.first), trianglesSize * sizeof(std::uint16_t));
+        }
+        else
+        {
+            ofs.write(reinterpret_cast<const char*>(tree.triangles_.data() + n.first), trianglesSize * sizeof(unsigned int));
+        }
+
+        // Write orders of cluster
+        if (leaf != VertexBspTree::notLeaf && leaf != VertexBspTree::noOrders)
+        {
+            ofs.write(reinterpret_cast<const char*>(tree.clusterOrders_.data() + leaf), bsp::clusterDirections.size() * trianglesSize / 3);
+        }
 
         // Write child nodes
-        writeNode(ofs, node->behind);
-        writeNode(ofs, node->infront);
+        if (leaf == VertexBspTree::notLeaf)
+        {
+            writeNode(ofs, tree, slot.child(node, false), n.behind, pendingIds);
+            writeNode(ofs, tree, slot.child(node, true), n.infront, pendingIds);
+        }
+    }
+    else if (pendingIds && pendingIds->contains(slot))
+    {
+        // Write subtree left to build
+        NodeTag tag = PendingNode;
+        ofs.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+
+        size_t pendingId = pendingIds->at(slot);
+        ofs.write(reinterpret_cast<const char*>(&pendingId), sizeof(pendingId));
     }
     else
     {
         // Write absence of node
-        bool hasNode = false;
-        ofs.write(reinterpret_cast<const char*>(&hasNode), sizeof(hasNode));
+        NodeTag tag = NoNode;
+        ofs.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
     }
 }
 
 //--------------------------------------------------------------------------
-inline std::unique_ptr<VertexBspTreeType::Node> readNode(std::ifstream &ifs) noexcept
+inline void readNode(std::ifstream &ifs, VertexBspTree &tree, const VertexBspTree::Slot &slot, VertexBspTree::PendingSlots *pendingSlots) noexcept
 {
-    bool hasNode;
-    ifs.read(reinterpret_cast<char*>(&hasNode), sizeof(hasNode));
+    NodeTag tag = NoNode;
+    ifs.read(reinterpret_cast<char*>(&tag), sizeof(tag));
 
-    if (hasNode)
+    if (tag == HasNode || tag == LeafNode || tag == NarrowNode || tag == NarrowLeafNode || tag == ClusterNode || tag == NarrowClusterNode)
     {
-        auto node = std::make_unique<VertexBspTreeType::Node>();
+        const VertexBspTree::node_index node = static_cast<VertexBspTree::node_index>(tree.nodes_.size());
+        VertexBspTree::Node &n = tree.nodes_.emplace_back();
 
         // Read plane
-        ifs.read(reinterpret_cast<char*>(&std::get<0>(node->plane)), sizeof(VertexBspTreeType::point_type));
-        ifs.read(reinterpret_cast<char*>(&std::get<1>(node->plane)), sizeof(VertexBspTreeType::coord_type));
+        ifs.read(reinterpret_cast<char*>(&std::get<0>(n.plane)), sizeof(VertexBspTreeType::point_type));
+        ifs.read(reinterpret_cast<char*>(&std::get<1>(n.plane)), sizeof(VertexBspTreeType::coord_type));
 
         // Read triangles
-        size_t trianglesSize;
+        size_t trianglesSize = 0;
         ifs.read(reinterpret_cast<char*>(&trianglesSize), sizeof(trianglesSize));
-        node->triangles.resize(trianglesSize);
-        ifs.read(reinterpret_cast<char*>(node->triangles.data()), trianglesSize * sizeof(unsigned int));
+        n.count = static_cast<std::uint32_t>(trianglesSize);
+        if (tag == NarrowNode || tag == NarrowLeafNode || tag == NarrowClusterNode)
+        {
+            n.first = static_cast<std::uint32_t>(tree.narrowTriangles_.size());
+            tree.narrowTriangles_.resize(tree.narrowTriangles_.size() + trianglesSize);
+            ifs.read(reinterpret_cast<char*>(tree.narrowTriangles_.data() + n.first), trianglesSize * sizeof(std::uint16_t));
+        }
+        else
+        {
+            n.first = static_cast<std::uint32_t>(tree.triangles_.size());
+            tree.triangles_.resize(tree.triangles_.size() + trianglesSize);
+            ifs.read(reinterpret_cast<char*>(tree.triangles_.data() + n.first), trianglesSize * sizeof(unsigned int));
+        }
 
-        // Read child nodes
-        node->behind = readNode(ifs);
-        node->infront = readNode(ifs);
+        // Read orders of cluster
+        if (tag == ClusterNode || tag == NarrowClusterNode)
+        {
+            const std::uint32_t orders = static_cast<std::uint32_t>(tree.clusterOrders_.size());
+            tree.clusterOrders_.resize(tree.clusterOrders_.size() + bsp::clusterDirections.size() * trianglesSize / 3);
+            ifs.read(reinterpret_cast<char*>(tree.clusterOrders_.data() + orders), bsp::clusterDirections.size() * trianglesSize / 3);
+            tree.setLeaf(node, orders);
+        }
+        else if (tag == LeafNode || tag == NarrowLeafNode)
+        {
+            tree.setLeaf(node, VertexBspTree::noOrders);
+        }
+
+        tree.linkNode(slot, node);
 
-        return node;
+        // Read child nodes
+        if (tag == HasNode || tag == NarrowNode)
+        {
+            readNode(ifs, tree, slot.child(node, false), pendingSlots);
+            readNode(ifs, tree, slot.child(node, true), pendingSlots);
+        }
     }
-    else
+    else if (tag == PendingNode && pendingSlots)
     {
-        return nullptr;
+        // Remember where the subtree left to build goes
+        size_t pendingId;
+        ifs.read(reinterpret_cast<char*>(&pendingId), sizeof(pendingId));
+        if (pendingId < pendingSlots->size())
+        {
+            (*pendingSlots)[pendingId] = slot;
+        }
     }
 }
@@ -5,8 +5,30 @@
 #include "thirdparty/bsptree.hpp"
 
 #include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
 #include <glm/geometric.hpp>
 
+#include <assimp/mesh.h>
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+// the indices of the triangles of an assimp mesh, read in place from its faces, which must
+// all be triangles
+struct MeshFaces
+{
+    const aiMesh* mesh;
+
+    // check if every face of the mesh is a triangle, so it can be read in place
+    bool triangulated() const noexcept;
+
+    // copy the indices of the triangles of the faces, polygons are split into fans of triangles
+    // and points and lines are left out
+    std::vector<unsigned int> triangleIndices() const;
+};
+
 namespace bsp
 {
     template <>
@@ -23,6 +45,16 @@ namespace bsp
         {
             return glm::dot(a, b);
         }
+
+        static inline coordinate_type coordinate(const glm::vec3& a, std::size_t i)
+        {
+            return a[static_cast<glm::length_t>(i)];
+        }
+
+        static inline glm::vec3 make(coordinate_type x, coordinate_type y, coordinate_type z)
+        {
+            return glm::vec3(x, y, z);
+        }
     };
 
     template <>
@@ -40,6 +72,23 @@ namespace bsp
             return (a * (1 - i) + b * i);
         }
     };
+
+    template <>
+    struct container_traits<MeshFaces>
+    {
+        typedef std::size_t size_type;
+        typedef unsigned int value_type;
+
+        static inline value_type get(const MeshFaces& faces, size_type i)
+        {
+            return faces.mesh->mFaces[i / 3].mIndices[i % 3];
+        }
+
+        static inline size_type getSize(const MeshFaces& faces) noexcept
+        {
+            return size_type(faces.mesh->mNumFaces) * 3;
+        }
+    };
 }
 
 typedef bsp::BspTree<std::vector<Vertex>, std::vector<unsigned int>> VertexBspTreeType;
@@ -48,13 +97,37 @@ class VertexBspTree : public VertexBspTreeType
 {
 public:
     VertexBspTree();
-    VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices);
-    VertexBspTree(std::vector<Vertex> && vertices);
+    VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices, const bsp::BuildOptions & options = {});
+    VertexBspTree(std::vector<Vertex> && vertices, const bsp::BuildOptions & options = {});
+    // build the tree and save a checkpoint into checkpointFilename every options.checkpointInterval seconds
+    VertexBspTree(std::vector<Vertex> && vertices, const std::vector<unsigned int> & indices, const bsp::BuildOptions & options,
+                  const std::string & checkpointFilename);
+    // build the tree of the triangles of a mesh, the faces of a triangulated mesh are read in place
+    // instead of being copied into indices first, the build still copies the indices once into the
+    // triangles it consumes, the faces of other meshes are copied by MeshFaces::triangleIndices
+    VertexBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options = {});
+    VertexBspTree(std::vector<Vertex> && vertices, const MeshFaces & faces, const bsp::BuildOptions & options,
+                  const std::string & checkpointFilename);
 
     bool save(const std::string &filename) const noexcept;
     bool load(const std::string &filename) noexcept;
 
+    // write the statistics of the build as JSON
+    bool saveStatistics(const std::string &filename) const noexcept;
+
+    // continue the build saved in a checkpoint, further checkpoints are saved into the same file
+    bool resume(const std::string &checkpointFilename, const bsp::BuildOptions & options);
+
+    // the view frustum of a projection and model view matrix, in the coordinates of the vertices
+    static Frustum makeFrustum(const glm::mat4 & modelViewProjection);
+
 protected:
-    friend void writeNode(std::ofstream &ofs, const std::unique_ptr<VertexBspTreeType::Node> &node) noexcept;
-    friend std::unique_ptr<VertexBspTreeType::Node> readNode(std::ifstream &ifs) noexcept;
+    // write the copy of the build of a checkpoint
+    static bool saveCheckpoint(const std::string &filename, Checkpoint &&checkpoint) noexcept;
+
+    typedef std::map<Slot, std::size_t> PendingIds;
+    typedef std::vector<std::optional<Slot>> PendingSlots;
+
+    friend void writeNode(std::ofstream &ofs, const VertexBspTree &tree, const Slot &slot, node_index node, const VertexBspTree::PendingIds *pendingIds) noexcept;
+    friend void readNode(std::ifstream &ifs, VertexBspTree &tree, const Slot &slot, VertexBspTree::PendingSlots *pendingSlots) noexcept;
 };
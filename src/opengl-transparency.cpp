@@ -48,6 +48,10 @@
 #define ZFAR 10.0f
 #define FPS_TIME_WINDOW 1
 #define MAX_DEPTH 1.0
+// fewest indices per range on average for the BSP ranges mode to draw the ranges, below that,
+// e.g. with leaf buckets or clusters, rewriting the indices costs less than the many small draws,
+// and the tree is drawn from the sorted buffer from then on
+#define BSP_MIN_RANGE_SIZE 64
 
 int g_numPasses = 4;
 int g_imageWidth = 1024;
@@ -150,6 +154,16 @@ GLuint g_bspEboId = 0;
 GLuint g_bspVaoId = 0;
 GLsync g_syncBuffer = 0;
 unsigned int* g_bspIndicesBufferData = nullptr;
+VertexBspTree::SortState g_bspSortState;
+
+GLuint g_bspRangesEboId = 0;
+GLuint g_bspRangesVaoId = 0;
+VertexBspTree::SortState g_bspRangesState;
+std::vector<VertexBspTree::DrawRange> g_bspRanges;
+std::vector<GLsizei> g_bspRangeCounts;
+std::vector<const void*> g_bspRangeOffsets;
+std::vector<GLint> g_bspRangeBases;
+bool g_bspDrawRanges = true;
 
 GLenum g_drawBuffers[] = { GL_COLOR_ATTACHMENT0,
                            GL_COLOR_ATTACHMENT1,
@@ -443,17 +457,7 @@ void InitBSP()
         vertices.push_back(vertex);
     }
 
-    std::vector<unsigned int> indices;
-    indices.reserve(g_model->mNumFaces * 3);
-
-    for (unsigned int i = 0; i < g_model->mNumFaces; ++i) {
-        const aiFace &face = g_model->mFaces[i];
-        for (unsigned int j = 0; j < 3 && j < face.mNumIndices; j++) {
-            indices.push_back(face.mIndices[j]);
-        }
-    }
-
-    g_bspTree = new VertexBspTree(std::move(vertices), indices);
+    g_bspTree = new VertexBspTree(std::move(vertices), MeshFaces{ g_model });
 #else
     std::cout << "loading BSP..." << std::endl;
 
@@ -474,22 +478,47 @@ void InitBSP()
     glBindVertexArray(g_bspVaoId);
 
     const std::vector<Vertex>& bspVertices = g_bspTree->getVertices();
-    std::vector<unsigned int> bspIndices = g_bspTree->sort(glm::vec3(-1, -1, -1));
-    g_bspIndicesBufferData = CreateMappedBufferData(g_bspVboId, g_bspEboId, bspVertices, bspIndices.size());
+    g_bspIndicesBufferData = CreateMappedBufferData(g_bspVboId, g_bspEboId, bspVertices, g_bspTree->indexCount());
+
+    // the indices of the nodes are stored once and drawn by ranges in the BSP ranges mode,
+    // as 16 bit offsets from the base vertex of each range when the tree is narrow
+    glGenBuffers(1, &g_bspRangesEboId);
+    glGenVertexArrays(1, &g_bspRangesVaoId);
+
+    glBindVertexArray(g_bspRangesVaoId);
+
+    if (g_bspTree->narrow())
+    {
+        std::vector<unsigned short> bspNodeOffsets(g_bspTree->indexCount());
+        g_bspTree->nodeOrderOffsets(bspNodeOffsets.data());
+        CreateIndexBufferData(g_bspVboId, g_bspRangesEboId, bspNodeOffsets);
+    }
+    else
+    {
+        std::vector<unsigned int> bspNodeIndices(g_bspTree->indexCount());
+        g_bspTree->nodeOrderIndices(bspNodeIndices.data());
+        CreateIndexBufferData(g_bspVboId, g_bspRangesEboId, bspNodeIndices);
+    }
 
     std::cout << bspVertices.size() << " vertices" << std::endl;
-    std::cout << (bspIndices.size() / 3) << " triangles" << std::endl;
+    std::cout << (g_bspTree->indexCount() / 3) << " triangles" << std::endl;
 }
 
 //--------------------------------------------------------------------------
 void DeleteBSP()
 {
     delete g_bspTree;
+    g_bspSortState = {};
+    g_bspRangesState = {};
+    g_bspDrawRanges = true;
 
     glDeleteBuffers(1, &g_bspVboId);
     glDeleteBuffers(1, &g_bspEboId);
     glDeleteVertexArrays(1, &g_bspVaoId);
 
+    glDeleteBuffers(1, &g_bspRangesEboId);
+    glDeleteVertexArrays(1, &g_bspRangesVaoId);
+
     glDeleteSync(g_syncBuffer);
 }
 
@@ -1319,11 +1348,52 @@ void RenderBSP()
 
     glm::mat4 inverseViewMatrix = glm::inverse(g_modelViewMatrix);
     glm::vec3 cameraPosition = glm::vec3(glm::column(inverseViewMatrix, 3));
-    std::vector<unsigned int> bspIndices = g_bspTree->sort(cameraPosition);
-    std::memcpy(g_bspIndicesBufferData, bspIndices.data(), bspIndices.size() * sizeof(unsigned int));
+    // the subtrees outside of the view are neither sorted nor drawn
+    const VertexBspTree::Frustum frustum = VertexBspTree::makeFrustum(g_projectionMatrix * g_modelViewMatrix);
+    // the indices stay in place, only the ranges to draw are sorted, until the ranges of a frame
+    // are too small, then that frame still draws its ranges and the next ones rewrite the indices,
+    // so each frame sorts the tree once
+    if (g_mode == BSP_RANGES_MODE && g_bspDrawRanges)
+    {
+        const std::size_t rangeCount = g_bspTree->sortRanges(cameraPosition, g_bspRanges, g_bspRangesState, &frustum);
+        std::size_t rangeIndexCount = 0;
+        for (const VertexBspTree::DrawRange& range : g_bspRanges)
+        {
+            rangeIndexCount += range.count;
+        }
+        g_bspDrawRanges = (rangeCount * BSP_MIN_RANGE_SIZE <= rangeIndexCount);
+
+        const bool narrow = g_bspTree->narrow();
+        const std::size_t indexSize = narrow ? sizeof(unsigned short) : sizeof(unsigned int);
+        g_bspRangeCounts.resize(rangeCount);
+        g_bspRangeOffsets.resize(rangeCount);
+        g_bspRangeBases.resize(rangeCount);
+        for (std::size_t i = 0; i < rangeCount; ++i)
+        {
+            g_bspRangeCounts[i] = static_cast<GLsizei>(g_bspRanges[i].count);
+            g_bspRangeOffsets[i] = reinterpret_cast<const void*>(g_bspRanges[i].first * indexSize);
+            g_bspRangeBases[i] = static_cast<GLint>(g_bspRanges[i].base);
+        }
 
-    glBindVertexArray(g_bspVaoId);
-    glDrawElements(GL_TRIANGLES, bspIndices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(g_bspRangesVaoId);
+        if (narrow)
+        {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, g_bspRangeCounts.data(), GL_UNSIGNED_SHORT, g_bspRangeOffsets.data(), static_cast<GLsizei>(rangeCount), g_bspRangeBases.data());
+        }
+        else
+        {
+            glMultiDrawElements(GL_TRIANGLES, g_bspRangeCounts.data(), GL_UNSIGNED_INT, g_bspRangeOffsets.data(), static_cast<GLsizei>(rangeCount));
+        }
+    }
+    else
+    {
+        // also the BSP ranges mode once the ranges of the tree were too small to draw one by one
+        // while the whole model is in view, only the subtrees whose order changed since the previous frame are written to the buffer
+        const std::size_t indexCount = g_bspTree->sortVisible(cameraPosition, frustum, g_bspIndicesBufferData, g_bspSortState);
+
+        glBindVertexArray(g_bspVaoId);
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indexCount), GL_UNSIGNED_INT, 0);
+    }
 
     g_numGeoPasses++;
 
@@ -1371,6 +1441,7 @@ void displayFunc()
             RenderWeightedSum();
             break;
         case BSP_MODE:
+        case BSP_RANGES_MODE:
             RenderBSP();
             break;
     }
@@ -1557,6 +1628,9 @@ void keyboardFunc(unsigned char key, int x, int y)
         case '7':
             g_mode = BSP_MODE;
             break;
+        case '8':
+            g_mode = BSP_RANGES_MODE;
+            break;
         case 'a':
             g_opacity -= 0.05f;
             g_opacity = std::max(g_opacity, 0.0f);
@@ -1590,6 +1664,7 @@ void InitMenus()
         glutAddMenuEntry("'3' - Weighted average mode", '3');
         glutAddMenuEntry("'4' - Weighted sum mode", '4');
         glutAddMenuEntry("'5' - BSP mode", '5');
+        glutAddMenuEntry("'8' - BSP ranges mode", '8');
         glutAddMenuEntry("'A' - dec uniform opacity", 'A');
         glutAddMenuEntry("'D' - inc uniform opacity", 'D');
         glutAddMenuEntry("'R' - Reload shaders", 'R');
@@ -1616,6 +1691,7 @@ int main(int argc, char *argv[])
     std::cout << "     3         - Weighted average mode" << std::endl;
     std::cout << "     4         - Weighted sum mode" << std::endl;
     std::cout << "     5         - BSP mode" << std::endl;
+    std::cout << "     8         - BSP ranges mode" << std::endl;
     std::cout << "     R         - Reload all shaders" << std::endl;
     std::cout << "     B         - Change background color" << std::endl;
     std::cout << "     Q         - Toggle occlusion queries" << std::endl;
@@ -6,17 +6,30 @@
 #include <limits>
 #include <cmath>
 #include <array>
+#include <atomic>
+#include <optional>
+#include <numeric>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <functional>
+#include <utility>
+#include <chrono>
+#include <map>
+#include <set>
+#include <type_traits>
+#include <vector>
 
 #include <algorithm>
 #include <ranges>
 
-#ifdef PRINT_LOG
-#include <iostream>
-#include <chrono>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
 #endif
 
 #ifdef PARALLEL
 #include <execution>
+#include <tbb/task_group.h>
 #define EXECUTION_PAR std::execution::par,
 #else
 #define EXECUTION_PAR
@@ -24,11 +37,35 @@
 
 namespace bsp {
 
+#ifdef PARALLEL
+/// group of tasks that build subtrees in parallel
+using TaskGroup = tbb::task_group;
+/// lock of the vertices and nodes shared by the tasks
+using BuildMutex = std::shared_mutex;
+#else
+/// without parallelism the tasks are run right away
+struct TaskGroup
+{
+  template <class F> void run(F && f) { f(); }
+  void wait() noexcept {}
+};
+/// and there is nothing to lock
+struct BuildMutex
+{
+  void lock() noexcept {}
+  void unlock() noexcept {}
+  void lock_shared() noexcept {}
+  void unlock_shared() noexcept {}
+};
+#endif
+
 /// specialize this template for your point type
-/// you must provide the following value_type and two functions:
+/// you must provide the following value_type and three functions:
 /// coordinate_type, which provides the type of one coordinate of a point
 /// cross(const P & a, const P & b), which returns the cross product of both points
 /// dot(const P a &, const P a &), which returns the dot product of both points
+/// coordinate(const P & a, std::size_t i), which returns the i-th coordinate (x, y or z) of the point
+/// make(coordinate_type x, coordinate_type y, coordinate_type z), which returns the point with these coordinates
 template <class P> struct point_traits;
 
 /// specialize this template for your vertex type
@@ -62,6 +99,14 @@ template<class V> struct container_traits
   {
     v.insert(v.end(), v2.begin(), v2.end());
   }
+  static void append(V & v, const V & v2, size_type first, size_type count)
+  {
+    v.insert(v.end(), v2.begin() + first, v2.begin() + first + count);
+  }
+  static void set(V & v, size_type i, const value_type & val)
+  {
+    v[i] = val;
+  }
   static size_type getSize(const V & v) noexcept
   {
     return v.size();
@@ -76,6 +121,253 @@ template<class V> struct container_traits
   }
 };
 
+/// split type of a triangle, made of the sides of its 3 vertices relative to a plane, each side
+/// being 0 behind, 1 on or 2 in front of the plane, it is used as index into the lookup tables below
+constexpr std::size_t splitType(std::size_t a, std::size_t b, std::size_t c) noexcept
+{
+  return a*9 + b*3 + c;
+}
+
+/// number of triangles that end up behind and in front of a plane for each split type, a triangle
+/// split with one vertex on the plane gives 2 triangles, otherwise the side with 2 vertices gets 2
+constexpr std::array<std::array<std::uint8_t, 2>, 27> splitCounts = []()
+{
+  std::array<std::array<std::uint8_t, 2>, 27> counts{};
+  for (std::size_t type = 0; type < 27; type++)
+  {
+    const std::array<std::size_t, 3> side { type / 9, type / 3 % 3, type % 3 };
+    const auto behind = std::ranges::count(side, 0);
+    const auto infront = std::ranges::count(side, 2);
+    counts[type][0] = std::uint8_t(behind > 0 ? (infront > 0 ? behind : 1) : 0);
+    counts[type][1] = std::uint8_t(infront > 0 ? (behind > 0 ? infront : 1) : 0);
+  }
+  return counts;
+}();
+
+/// the view directions for which the order of the triangles of a cluster is precomputed, the axes,
+/// the diagonals of the faces and the diagonals of a cube, the opposite directions use the reverse
+constexpr std::array<std::array<double, 3>, 13> clusterDirections = []()
+{
+  constexpr double d2 = 0.70710678118654752440; // 1 / sqrt(2)
+  constexpr double d3 = 0.57735026918962576451; // 1 / sqrt(3)
+  return std::array<std::array<double, 3>, 13>{{
+    { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },
+    { d2, d2, 0 }, { d2, -d2, 0 }, { d2, 0, d2 }, { d2, 0, -d2 }, { 0, d2, d2 }, { 0, d2, -d2 },
+    { d3, d3, d3 }, { d3, d3, -d3 }, { d3, -d3, d3 }, { -d3, d3, d3 }
+  }};
+}();
+
+/// the most triangles of a cluster, the precomputed orders store triangles as bytes
+constexpr std::size_t maxClusterSize = 256;
+
+/// structure of arrays copy of the corner positions of a list of triangles, so classifying all
+/// triangles against a plane streams through memory and can be vectorized
+template <class T>
+struct TrianglePositions
+{
+  /// x, y and z of the first corner, then of the second and of the third corner
+  std::array<std::vector<T>, 9> corners;
+
+  std::size_t size() const noexcept { return corners[0].size(); }
+};
+
+/// write the split type of the triangles [first, first + count) of positions relative to the plane
+/// with the given normal and offset into types, vertices closer than epsilon to the plane are on it
+template <class T>
+void classifyTriangles(const TrianglePositions<T> & positions, std::size_t first, std::size_t count,
+                       const std::array<T, 3> & normal, T offset, T epsilon, std::uint8_t * types) noexcept
+{
+  std::size_t t = 0;
+
+  if constexpr (std::is_same_v<T, float>)
+  {
+    const auto corner = [&positions, first](std::size_t c) { return positions.corners[c].data() + first; };
+
+#if defined(__AVX2__)
+    // 8 triangles at once
+    const __m256 nx = _mm256_set1_ps(normal[0]), ny = _mm256_set1_ps(normal[1]), nz = _mm256_set1_ps(normal[2]);
+    const __m256 d = _mm256_set1_ps(offset), pe = _mm256_set1_ps(epsilon), ne = _mm256_set1_ps(-epsilon);
+    const __m256i one = _mm256_set1_epi32(1);
+    for (; t + 8 <= count; t += 8)
+    {
+      __m256i type = _mm256_setzero_si256();
+      for (std::size_t c = 0; c < 3; c++)
+      {
+        const __m256 dist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(
+          _mm256_mul_ps(nx, _mm256_loadu_ps(corner(3*c  ) + t)),
+          _mm256_mul_ps(ny, _mm256_loadu_ps(corner(3*c+1) + t))),
+          _mm256_mul_ps(nz, _mm256_loadu_ps(corner(3*c+2) + t))), d);
+        // masks are -1 when true, so the side is 1 - (dist > epsilon) + (dist < -epsilon)
+        const __m256i side = _mm256_add_epi32(_mm256_sub_epi32(one,
+          _mm256_castps_si256(_mm256_cmp_ps(dist, pe, _CMP_GT_OQ))),
+          _mm256_castps_si256(_mm256_cmp_ps(dist, ne, _CMP_LT_OQ)));
+        type = _mm256_add_epi32(_mm256_mullo_epi32(type, _mm256_set1_epi32(3)), side);
+      }
+      alignas(32) std::array<std::int32_t, 8> lanes;
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.data()), type);
+      for (std::size_t l = 0; l < 8; l++) types[t + l] = std::uint8_t(lanes[l]);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    // 4 triangles at once
+    const __m128 nx = _mm_set1_ps(normal[0]), ny = _mm_set1_ps(normal[1]), nz = _mm_set1_ps(normal[2]);
+    const __m128 d = _mm_set1_ps(offset), pe = _mm_set1_ps(epsilon), ne = _mm_set1_ps(-epsilon);
+    const __m128i one = _mm_set1_epi32(1);
+    for (; t + 4 <= count; t += 4)
+    {
+      __m128i type = _mm_setzero_si128();
+      for (std::size_t c = 0; c < 3; c++)
+      {
+        const __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+          _mm_mul_ps(nx, _mm_loadu_ps(corner(3*c  ) + t)),
+          _mm_mul_ps(ny, _mm_loadu_ps(corner(3*c+1) + t))),
+          _mm_mul_ps(nz, _mm_loadu_ps(corner(3*c+2) + t))), d);
+        // masks are -1 when true, so the side is 1 - (dist > epsilon) + (dist < -epsilon)
+        const __m128i side = _mm_add_epi32(_mm_sub_epi32(one,
+          _mm_castps_si128(_mm_cmpgt_ps(dist, pe))),
+          _mm_castps_si128(_mm_cmplt_ps(dist, ne)));
+        // type * 3 + side, without the SSE4.1 multiplication
+        type = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(type, type), type), side);
+      }
+      alignas(16) std::array<std::int32_t, 4> lanes;
+      _mm_store_si128(reinterpret_cast<__m128i*>(lanes.data()), type);
+      for (std::size_t l = 0; l < 4; l++) types[t + l] = std::uint8_t(lanes[l]);
+    }
+#endif
+  }
+
+  // remaining triangles, or all of them when there is no vector unit for T
+  for (; t < count; t++)
+  {
+    std::size_t type = 0;
+    for (std::size_t c = 0; c < 3; c++)
+    {
+      const T dist = normal[0] * positions.corners[3*c  ][first + t]
+                   + normal[1] * positions.corners[3*c+1][first + t]
+                   + normal[2] * positions.corners[3*c+2][first + t] - offset;
+      type = type * 3 + ((dist > epsilon) ? 2 : ((dist < -epsilon) ? 0 : 1));
+    }
+    types[t] = std::uint8_t(type);
+  }
+}
+
+/// statistics of the nodes built at one depth of the tree
+struct DepthStatistics
+{
+  /// nodes built, leaf buckets included
+  std::size_t nodes = 0;
+  /// leaf buckets built
+  std::size_t leaves = 0;
+  /// triangles of the subtrees of the nodes
+  std::size_t triangles = 0;
+  /// triangles split by the planes of the nodes
+  std::size_t splitTriangles = 0;
+  /// vertices created by splitting triangles
+  std::size_t addedVertices = 0;
+  /// seconds spent choosing the planes of the nodes, summed over all threads
+  double pivotSeconds = 0;
+  /// seconds spent separating the triangles of the nodes, summed over all threads
+  double partitionSeconds = 0;
+
+  DepthStatistics & operator+=(const DepthStatistics & other) noexcept
+  {
+    nodes += other.nodes;
+    leaves += other.leaves;
+    triangles += other.triangles;
+    splitTriangles += other.splitTriangles;
+    addedVertices += other.addedVertices;
+    pivotSeconds += other.pivotSeconds;
+    partitionSeconds += other.partitionSeconds;
+    return *this;
+  }
+};
+
+/// statistics of a build, collected while the tree is built
+struct BuildStatistics
+{
+  /// statistics of each depth of the tree, the root being at depth 0
+  std::vector<DepthStatistics> depths;
+  /// triangles stored in the nodes built so far
+  std::size_t placedTriangles = 0;
+  /// triangles of the subtrees left to build, only in the progress reports, a finished build has none
+  std::size_t remainingTriangles = 0;
+  /// number of triangles of each subtree left to build, only in the progress reports
+  std::multiset<std::size_t> remainingSubtrees;
+  /// seconds since the build started
+  double seconds = 0;
+
+  /// statistics of all depths together
+  DepthStatistics total() const noexcept
+  {
+    DepthStatistics sum;
+    for (const DepthStatistics & depth : depths) sum += depth;
+    return sum;
+  }
+
+  /// estimate of the part of the build that is done, between 0 and 1, splits add triangles
+  /// to the remaining subtrees so it does not grow steadily
+  double progress() const noexcept
+  {
+    const std::size_t all = placedTriangles + remainingTriangles;
+    return (all > 0) ? double(placedTriangles) / double(all) : 1.0;
+  }
+};
+
+/// options to control how the tree is built
+struct BuildOptions
+{
+  /// maximum number of candidate pivot triangles scored per node, 0 means no limit
+  std::size_t pivotSamples = 0;
+  /// fraction of the triangles of a node scored as candidate pivots, 1 means all of them
+  double pivotSampleRatio = 1;
+  /// subtrees with less triangles are built serially by the task of their parent, larger ones
+  /// are built by tasks of their own (only when built with PARALLEL)
+  std::size_t parallelCutoff = 512;
+  /// seconds between two checkpoints of a build that can be resumed, 0 means no checkpoints
+  double checkpointInterval = 0;
+  /// subtrees with at most this many triangles become leaf buckets instead of being split further,
+  /// the triangles of a leaf are sorted by the distance of their centroid when the tree is sorted,
+  /// which is only approximate within the leaf, 0 means no leaf buckets
+  std::size_t leafSize = 0;
+  /// depth from which subtrees become leaf buckets, the root being at depth 0, 0 means no limit
+  std::size_t leafDepth = 0;
+  /// seconds of build after which all remaining subtrees become leaf buckets, 0 means no limit
+  double leafAfter = 0;
+  /// subtrees with more triangles are split by an axis aligned plane through the median of the
+  /// triangle centroids along their longest axis instead of searching a pivot triangle, which is
+  /// much faster but splits more triangles, 0 means always search a pivot
+  std::size_t axisSplitAbove = 0;
+  /// build the tree over clusters of at most this many triangles, at most maxClusterSize, instead
+  /// of single triangles: subtrees are halved at the median of the triangle centroids along their
+  /// longest axis, triangles across the plane are split, and the triangles of each cluster are
+  /// ordered by the order precomputed for the closest of the clusterDirections, which makes the
+  /// build and the sort scale with the number of clusters, the clusters are in exact order, only the
+  /// triangles within a cluster are in approximate order, 0 means a triangle level tree
+  std::size_t clusterSize = 0;
+  /// weights of the score of a candidate pivot, the candidate with the lowest score is chosen and
+  /// equal scores are decided by the balance between both sides, the score is
+  /// splitWeight * triangles added by splits + balanceWeight * |behind - infront| - coplanarWeight * triangles on the plane
+  /// where the triangles on the plane are all the triangles coplanar with the pivot and the degenerated ones, as the node gets them
+  /// all weights must not be negative, the defaults minimize the triangles left to build below the node
+  double splitWeight = 1;
+  double balanceWeight = 0;
+  double coplanarWeight = 1;
+  /// vertices closer to a plane than this fraction of the size of the model (the diagonal of the
+  /// bounding box of its vertices) count as on the plane: the tolerance widens the epsilon of the
+  /// tree, the vertices keep their positions, so vertices almost on a plane do not create slivers
+  /// but a triangle that is a little across a plane stays whole on one side of it, 0 means only
+  /// the epsilon of the tree
+  double snapTolerance = 0;
+  /// splits that would create a piece with less than this fraction of the area of the triangle are
+  /// skipped and the triangle stays whole on the side of its larger part, which makes the order of
+  /// such triangles slightly wrong, 0 means always split
+  double sliverRatio = 0;
+  /// seconds between two calls of progress while the tree is built, 0 means no progress reports
+  double progressInterval = 0;
+  /// called with the statistics of the build so far, by one thread at a time, the depths count the
+  /// nodes of the tasks that ended, the nodes of the tasks still running are added when they end
+  std::function<void(const BuildStatistics &)> progress;
+};
+
 /// A class for a bsp-Tree. The tree is meant for OpenGL usage. You input container of vertices and
 /// a container of indices into the vertex container and you get a bsp tree that can order your
 /// polygons from back to front.
@@ -110,20 +402,179 @@ class BspTree
 
     typedef std::tuple<point_type, coord_type> Plane; // plane type
 
-    // type for the node of the bsp-tree
-    typedef struct Node {
+    // index of a node in nodes_
+    using node_index = std::uint32_t;
+    static constexpr node_index noNode = std::numeric_limits<node_index>::max();
+
+    // a node that is not a leaf, and a leaf that is not a cluster, which has no precomputed orders
+    static constexpr std::uint32_t notLeaf = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint32_t noOrders = notLeaf - 1;
+
+    // type for the node of the bsp-tree, only what a sort walks through, the plane, the triangles
+    // and the children, the rest is in leaves_ and bounds_
+    struct Node {
       Plane plane; // the plane that intersects the space
-      I triangles; // the triangles that are on this plane
-      std::unique_ptr<struct Node> behind; // all that is behind the plane (relative to normal of plane)
-      std::unique_ptr<struct Node> infront; // all that is in front of the plane
-    } Node;
+      std::uint32_t first = 0; // the triangles that are on this plane, as range of indices in triangles_, or in narrowTriangles_
+      std::uint32_t count = 0;
+      node_index behind = noNode; // all that is behind the plane (relative to normal of plane)
+      node_index infront = noNode; // all that is in front of the plane
+    };
+
+    // the bounding box of the triangles of the subtree of a node
+    struct Bounds {
+      point_type lower{};
+      point_type upper{};
+    };
+
+    // the place of a node in the tree, a child of a built node or the root when there is no parent
+    struct Slot
+    {
+      node_index parent = noNode;
+      bool infront = false;
+      std::uint32_t depth = 0; // the number of nodes above
+
+      // the slot of a child of the node in this slot
+      Slot child(node_index node, bool side) const noexcept { return Slot{ node, side, depth + 1 }; }
+
+      auto operator<=>(const Slot &) const = default;
+    };
+
+    // triangles that still need to be sorted into the tree
+    struct Triangles
+    {
+      I indices; // the indices of the triangles, 3 for each triangle
+      std::vector<Plane> planes; // the plane of each triangle, pieces of split triangles keep the plane of the original
+    };
+
+    // a subtree that still has to be built, with the place in the tree where it goes
+    struct PendingTree
+    {
+      Slot slot; // where the subtree goes
+      Triangles triangles; // the triangles of the subtree
+    };
+
+    // a copy of the build for a checkpoint, the nodes built so far and the subtrees left to build,
+    // with only the vertices their triangles use, renumbered in the order of vertices_
+    struct Checkpoint
+    {
+      std::vector<Node> nodes;
+      I triangles;
+      std::vector<std::uint32_t> leaves;
+      std::vector<std::uint8_t> clusterOrders;
+      std::map<Slot, Triangles> unbuilt;
+      C vertices;
+    };
+
+    // the nodes of the bsp-tree, the root first, children refer to each other by their index
+    std::vector<Node> nodes_;
+
+    // the indices of the triangles of all nodes, each node owns one range
+    I triangles_;
+
+    // the nodes from first on up to the first node of the next region have the same base vertex
+    // in a narrow tree, the nodes of a region are a whole subtree or a single node above them
+    struct Region
+    {
+      node_index first;
+      std::uint32_t base;
+    };
+
+    // the indices of the triangles of all nodes when the tree is narrow, instead of triangles_,
+    // as 16 bit offsets from the base vertex of the region of their node
+    std::vector<std::uint16_t> narrowTriangles_;
+
+    // the regions of the nodes of a narrow tree, in the order of their first node, empty when
+    // the tree is not narrow
+    std::vector<Region> regions_;
 
-    // pointer to root of bsp-tree
-    std::unique_ptr<Node> root_;
+    // for every node up to the last leaf, notLeaf, noOrders for a leaf bucket, or the orders of the
+    // triangles of a cluster in clusterOrders_, empty when the tree has no leaf
+    std::vector<std::uint32_t> leaves_;
+
+    // the bounding box of the subtree of every node
+    std::vector<Bounds> bounds_;
+
+    // the orders of the triangles of the clusters, one per direction of clusterDirections, each
+    // made of the positions of the triangles in the range of their node, the farthest first
+    std::vector<std::uint8_t> clusterOrders_;
+
+    // guards nodes_ and triangles_ while subtrees are built in parallel
+    BuildMutex nodesMutex_;
 
     // the vertices of all triangles within the tree
     C vertices_;
 
+    // guards vertices_ while subtrees are built in parallel, as separating triangles appends to it
+    mutable BuildMutex verticesMutex_;
+
+    // the subtrees buildPending starts from, the whole tree or the subtrees left in a checkpoint
+    std::vector<PendingTree> pending_;
+
+    // the triangles of every subtree that is not built yet, queued or being built, by the slot
+    // where it goes, guarded by nodesMutex_ so a checkpoint can be taken while the build goes on
+    std::map<Slot, const Triangles *> unbuilt_;
+
+    // writes a checkpoint of the build, empty when the build is not checkpointed, it is called
+    // by one task at a time with a copy of the build, while the other tasks go on
+    std::function<void(Checkpoint &&)> checkpoint_;
+    std::chrono::steady_clock::time_point nextCheckpoint_;
+    std::mutex checkpointMutex_;
+
+    // distance below which a vertex is on a plane, epsilon or larger with a snap tolerance
+    coord_type planeEpsilon_ = epsilon();
+
+    // from then on all remaining subtrees become leaf buckets
+    std::chrono::steady_clock::time_point leafDeadline_ = std::chrono::steady_clock::time_point::max();
+
+    // the options used to build the tree
+    BuildOptions options_;
+
+    // statistics of the build, with the time of the start of the build, each task collects the
+    // statistics of its nodes and adds them when it ends
+    BuildStatistics statistics_;
+    std::mutex statisticsMutex_;
+    std::chrono::steady_clock::time_point buildStart_;
+
+    // the time of the next progress report, guarded by progressMutex_ that is held while reporting
+    std::chrono::steady_clock::time_point nextProgress_;
+    std::mutex progressMutex_;
+
+  public:
+
+    /// distances of the triangles of a leaf bucket from the point of view, with their first index
+    typedef std::vector<std::pair<coord_type, size_type>> LeafOrder;
+
+    /// the scratch space of a sort, keep one between sorts so they do not allocate
+    struct SortScratch
+    {
+      LeafOrder leafOrder; // the order of the leaf bucket being sorted
+      std::vector<std::pair<node_index, bool>> stack; // the nodes left to visit, or to write their own triangles when true
+    };
+
+    /// what the previous resort into a buffer wrote, keep one for each buffer that is resorted
+    struct SortState
+    {
+      SortScratch scratch;
+      std::vector<std::uint8_t> views; // the side of each plane the point of view was on, or the view of each cluster
+      std::vector<size_type> sizes; // the number of indices of the subtree of each node
+      std::vector<std::pair<node_index, size_type>> stack; // the subtrees left to check, with their first index in the buffer
+      std::vector<std::pair<node_index, size_type>> subtrees; // the subtrees left to hand to tasks, with their first index
+      std::vector<size_type> firsts; // the first index of each node in the indices in node order
+    };
+
+    /// a range of the indices in node order to draw, in back to front order with the other ranges,
+    /// with the vertex that the 16 bit indices of a narrow tree are offsets from
+    struct DrawRange
+    {
+      size_type first;
+      size_type count;
+      std::uint32_t base = 0;
+    };
+
+    /// the planes of a view frustum, a point is visible when it is in front of all of them, the
+    /// normals do not need to be of unit length
+    typedef std::array<Plane, 6> Frustum;
+
   protected:
 
     // Some internal helper functions
@@ -131,13 +582,6 @@ class BspTree
     static constexpr const point_type& normal(const Plane & plane) noexcept { return std::get<0>(plane); }
     static constexpr const coord_type& offset(const Plane & plane) noexcept { return std::get<1>(plane); }
 
-    // a function that is used to contract the numbers between -1 and 1 into one, used
-    // for the categorisation of a triangles relation to the cutting plane
-    static constexpr size_type splitType(size_type a, size_type b, size_type c) noexcept
-    {
-      return (a+1)*16 + (b+1)*4 + (c+1);
-    }
-
     // calculate distance of a point from a plane
     static coord_type distance(const Plane & plane, const point_type & t) noexcept
     {
@@ -151,15 +595,10 @@ class BspTree
       return i * pow(i, e - 1);
     }
 
-    // calculate the sign of a number,
-    static constexpr size_type sign(coord_type i) noexcept
+    // the epsilon value for deciding if a point is on a plane
+    static constexpr coord_type epsilon() noexcept
     {
-      // the epsilon value for deciding if a point is on a plane
-      constexpr coord_type epsilon = pow(0.1, E);
-
-      if (i >  epsilon) return 1;
-      if (i < -epsilon) return -1;
-      return 0;
+      return pow(0.1, E);
     }
 
     // calculate the absolute number
@@ -177,25 +616,57 @@ class BspTree
       return abs(a) / (abs(a) + abs(b));
     }
 
-    // calculate the plane in hessian normal form for the triangle with the indices given in the triple p
+    // calculate the plane in hessian normal form for the triangle with the indices given in the triple p,
+    // a degenerated triangle gets a null normal
     Plane calculatePlane(size_type a, size_type b, size_type c) const noexcept
     {
       auto p1 = vertex_traits<vertex_type>::getPosition(get(vertices_, a));
       auto p2 = vertex_traits<vertex_type>::getPosition(get(vertices_, b));
       auto p3 = vertex_traits<vertex_type>::getPosition(get(vertices_, c));
 
-      auto norm = point_traits<point_type>::cross(p2 - p1, p3 - p1);
+      // check the length of the cross product before it is normalized, a normal with no length
+      // is not finite after the normalization, which can not be tested for with finite only math
+      const point_type e1 = p2 - p1;
+      const point_type e2 = p3 - p1;
+      coord_type length = 0;
+      for (size_type i = 0; i < 3; i++)
+      {
+        const size_type j = (i + 1) % 3, k = (i + 2) % 3;
+        const coord_type n = point_traits<point_type>::coordinate(e1, j) * point_traits<point_type>::coordinate(e2, k)
+                           - point_traits<point_type>::coordinate(e1, k) * point_traits<point_type>::coordinate(e2, j);
+        length += n * n;
+      }
+      if (length <= std::numeric_limits<coord_type>::min())
+      {
+        return std::make_tuple(point_traits<point_type>::make(0, 0, 0), coord_type(0));
+      }
+
+      auto norm = point_traits<point_type>::cross(e1, e2);
       auto p = point_traits<point_type>::dot(norm, p1);
 
       return std::make_tuple(norm, p);
     }
 
-    // append indices for a triangle to the index container
-    void append(I & v, index_type v1, index_type v2, index_type v3) const
+    // write the indices of a triangle as i-th triangle of the index container
+    void set(I & v, size_type i, index_type v1, index_type v2, index_type v3) const
+    {
+      container_traits<I>::set(v, 3*i,   v1);
+      container_traits<I>::set(v, 3*i+1, v2);
+      container_traits<I>::set(v, 3*i+2, v3);
+    }
+
+    // write a triangle with its plane as i-th triangle of the triangles
+    void set(Triangles & t, size_type i, index_type v1, index_type v2, index_type v3, const Plane & plane) const
+    {
+      set(t.indices, i, v1, v2, v3);
+      t.planes[i] = plane;
+    }
+
+    // resize the triangles to hold count triangles
+    static void resize(Triangles & t, size_type count)
     {
-      container_traits<I>::append(v, v1);
-      container_traits<I>::append(v, v2);
-      container_traits<I>::append(v, v3);
+      container_traits<I>::resize(t.indices, 3 * count);
+      t.planes.resize(count);
     }
 
     // helper function to get element from container using the traits
@@ -209,398 +680,1907 @@ class BspTree
       return get(vertices_, get(indices, i));
     }
 
-    // separate the triangles within indices into the 3 lists of triangles that are behind, infront and on the
-    // plane of the triangle given in pivot
-    // when needed triangles are split and the smaller triangles are added to the proper lists
-    // return the plane
-    Plane separateTriangles(size_type pivot, const I & indices, I & behind, I & infront, I & onPlane)
-    {
-      // get the plane of the pivot triangle
-      const Plane plane = calculatePlane(
-        get(indices, pivot  ),
-        get(indices, pivot+1),
-        get(indices, pivot+2)
-      );
+    // copy the corner positions of the triangles in indices into a structure of arrays
+    TrianglePositions<coord_type> gatherPositions(const I & indices) const
+    {
+      TrianglePositions<coord_type> positions;
+      const size_type triangles = container_traits<I>::getSize(indices) / 3;
+      for (auto & corner : positions.corners) corner.resize(triangles);
 
-      // go over all triangles and separate them
-      for (size_type i = 0; i < container_traits<I>::getSize(indices); i+=3)
+      std::shared_lock lock(verticesMutex_);
+
+      for (size_type t = 0; t < triangles; t++)
       {
-        // calculate distance of the 3 vertices from the choosen partitioning plane
-        std::array<coord_type, 3> dist
+        for (size_type c = 0; c < 3; c++)
         {
-          distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i  , indices))),
-          distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i+1, indices))),
-          distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i+2, indices)))
-        };
-
-        // check on which side of the plane the 3 points are
-        std::array<size_type, 3> side { sign(dist[0]), sign(dist[1]), sign(dist[2]) };
-
-        // if necessary create intermediate points for triangle
-        // edges that cross the plane
-        // the new points will be on the plane and will be new
-        // vertices for new triangles
-        // we only need to calculate the intermediate points for an
-        // edge, when one vertex of the edge is on one side of the plan
-        // and the other one on the other side, so when the product of
-        // the signs is negative
-        std::array<index_type, 3> A;
-
-        if (side[0] * side[1] == -1)
-        {
-          A[0] = container_traits<C>::appendInterpolate(vertices_, getVertIndex(i  , indices), getVertIndex(i+1, indices), relation(dist[0], dist[1]));
-        }
-        if (side[1] * side[2] == -1)
-        {
-          A[1] = container_traits<C>::appendInterpolate(vertices_, getVertIndex(i+1, indices), getVertIndex(i+2, indices), relation(dist[1], dist[2]));
-        }
-        if (side[2] * side[0] == -1)
-        {
-          A[2] = container_traits<C>::appendInterpolate(vertices_, getVertIndex(i+2, indices), getVertIndex(i  , indices), relation(dist[2], dist[0]));
-        }
-
-        // go over all possible positions of the 3 vertices relative to the plane
-        switch (splitType(side[0], side[1], side[2]))
-        {
-          // all point on one side of the plane (or on the plane)
-          // in this case we simply add the complete triangle
-          // to the proper halve of the subtree
-          case splitType(-1, -1, -1):
-          case splitType(-1, -1,  0):
-          case splitType(-1,  0, -1):
-          case splitType(-1,  0,  0):
-          case splitType( 0, -1, -1):
-          case splitType( 0, -1,  0):
-          case splitType( 0,  0, -1):
-            append(behind, get(indices, i), get(indices, i+1), get(indices, i+2));
-            break;
-
-          case splitType( 0,  0,  1):
-          case splitType( 0,  1,  0):
-          case splitType( 0,  1,  1):
-          case splitType( 1,  0,  0):
-          case splitType( 1,  0,  1):
-          case splitType( 1,  1,  0):
-          case splitType( 1,  1,  1):
-            append(infront, get(indices, i  ), get(indices, i+1), get(indices, i+2));
-            break;
-
-          // triangle on the dividing plane
-          default:
-          case splitType( 0,  0,  0):
-            append(onPlane, get(indices, i  ), get(indices, i+1), get(indices, i+2));
-            break;
-
-          // and now all the ways that the triangle can be cut by the plane
-          case splitType( 1, -1,  0):
-            append(behind,  get(indices, i+1), get(indices, i+2), A[0]);
-            append(infront, get(indices, i+2), get(indices, i+0), A[0]);
-            break;
-
-          case splitType(-1,  0,  1):
-            append(behind,  get(indices, i+0), get(indices, i+1), A[2]);
-            append(infront, get(indices, i+1), get(indices, i+2), A[2]);
-            break;
-
-          case splitType( 0,  1, -1):
-            append(behind,  get(indices, i+2), get(indices, i+0), A[1]);
-            append(infront, get(indices, i+0), get(indices, i+1), A[1]);
-            break;
-
-          case splitType(-1,  1,  0):
-            append(behind,  get(indices, i+2), get(indices, i+0), A[0]);
-            append(infront, get(indices, i+1), get(indices, i+2), A[0]);
-            break;
-
-          case splitType( 1,  0, -1):
-            append(behind,  get(indices, i+1), get(indices, i+2), A[2]);
-            append(infront, get(indices, i+0), get(indices, i+1), A[2]);
-            break;
-
-          case splitType( 0, -1,  1):
-            append(behind,  get(indices, i+0), get(indices, i+1), A[1]);
-            append(infront, get(indices, i+2), get(indices, i+0), A[1]);
-            break;
-
-          case splitType( 1, -1, -1):
-            append(infront, get(indices, i+0), A[0],              A[2]);
-            append(behind,  get(indices, i+1), A[2],              A[0]);
-            append(behind,  get(indices, i+1), get(indices, i+2), A[2]);
-            break;
-
-          case splitType(-1,  1, -1):
-            append(infront, get(indices, i+1), A[1],              A[0]);
-            append(behind,  get(indices, i+2), A[0],              A[1]);
-            append(behind,  get(indices, i+2), get(indices, i+0), A[0]);
-            break;
-
-          case splitType(-1, -1,  1):
-            append(infront, get(indices, i+2), A[2],              A[1]);
-            append(behind,  get(indices, i+0), A[1],              A[2]);
-            append(behind,  get(indices, i+0), get(indices, i+1), A[1]);
-            break;
-
-          case splitType(-1,  1,  1):
-            append(behind,  get(indices, i+0), A[0],              A[2]);
-            append(infront, get(indices, i+1), A[2],              A[0]);
-            append(infront, get(indices, i+1), get(indices, i+2), A[2]);
-            break;
-
-          case splitType( 1, -1,  1):
-            append(behind,  get(indices, i+1), A[1],              A[0]);
-            append(infront, get(indices, i+0), A[0],              A[1]);
-            append(infront, get(indices, i+2), get(indices, i+0), A[1]);
-            break;
-
-          case splitType( 1,  1, -1):
-            append(behind,  get(indices, i+2), A[2],              A[1]);
-            append(infront, get(indices, i+0), A[1],              A[2]);
-            append(infront, get(indices, i+0), get(indices, i+1), A[1]);
-            break;
-
+          const auto p = vertex_traits<vertex_type>::getPosition(getVertIndex(3*t + c, indices));
+          for (size_type axis = 0; axis < 3; axis++)
+          {
+            positions.corners[3*c + axis][t] = point_traits<point_type>::coordinate(p, axis);
+          }
         }
       }
 
-      return plane;
+      return positions;
     }
 
-    typedef std::tuple<size_type, size_type> Pivot; // pivot type (number behind, number infront)
-    // helper to find the good pivot point
-    struct PivotCompare
+    // the normal of the plane as array of coordinates, as used by classifyTriangles
+    static std::array<coord_type, 3> normalCoordinates(const Plane & plane) noexcept
     {
-      // new pivot is better, if
-      // the total number of triangles is lower (less division)
-      // or equal and the triangles more equally distributed between left and right
-      //bool operator()(const Pivot & lhs, const Pivot & rhs) const
-      bool operator()(const std::pair<Pivot, size_type> & lhs, const std::pair<Pivot, size_type> & rhs) const
-      {
-        const auto [nb, nf]{ lhs.first };
-        size_type ns = nb+nf;
+      return {
+        point_traits<point_type>::coordinate(normal(plane), 0),
+        point_traits<point_type>::coordinate(normal(plane), 1),
+        point_traits<point_type>::coordinate(normal(plane), 2)
+      };
+    }
 
-        const auto [bb, bf]{ rhs.first };
-        size_type bs = bb+bf;
+    // an edge that crosses the plane, from the vertex with the lower index to the other one, with
+    // the distances of both vertices from the plane, edges are ordered and equal by their vertices
+    struct CutEdge
+    {
+      index_type a, b;
+      coord_type da, db;
 
-        return ((ns < bs) || ((ns == bs) && (abs(nb-nf) < abs(bb-bf))));
-      }
+      bool operator<(const CutEdge & other) const noexcept { return std::tie(a, b) < std::tie(other.a, other.b); }
+      bool operator==(const CutEdge & other) const noexcept { return a == other.a && b == other.b; }
     };
 
-    // check what would happen if the plane of pivot is used as a cutting plane for the triangles in indices
-    // returns the number of triangles that would end up on the plane of pivot, behind it or in front of it
-    Pivot evaluatePivot(size_type pivot, const I & indices) const noexcept
+    static CutEdge cutEdge(index_type a, index_type b, coord_type da, coord_type db) noexcept
     {
-      size_type behind = 0;
-      size_type infront = 0;
+      return (a < b) ? CutEdge{ a, b, da, db } : CutEdge{ b, a, db, da };
+    }
 
-      // count how many triangles would need to be cut, would lie behind and in front of the plane
-      const Plane plane = calculatePlane(
-        get(indices, pivot  ),
-        get(indices, pivot+1),
-        get(indices, pivot+2)
-      );
+    // we only need to calculate the intermediate point for an edge, when one vertex of the edge
+    // is on one side of the plane and the other one on the other side, so when one side is 0
+    // and the other one 2
+    static constexpr bool crosses(size_type a, size_type b) noexcept { return a + b == 2 && a != 1; }
 
-      // this is a simplification of the algorithm above to just count the numbers of triangles
-      for (size_type i = 0; i < container_traits<I>::getSize(indices); i+=3)
+    // change the types of the triangles [first, first + count) of positions that would be split into
+    // a piece with less than options_.sliverRatio of their area, so they stay whole on the side of
+    // their larger part: the vertices on the side of the smaller part are put on the plane
+    void suppressSlivers(const TrianglePositions<coord_type> & positions, size_type first, size_type count,
+                         const std::array<coord_type, 3> & normal, coord_type offset, std::uint8_t * types) const noexcept
+    {
+      if (options_.sliverRatio <= 0) return;
+
+      for (size_type t = 0; t < count; t++)
       {
-        std::array<size_type, 3> side
+        const size_type type = types[t];
+        if (splitCounts[type][0] == 0 || splitCounts[type][1] == 0) continue;
+
+        std::array<size_type, 3> side { type / 9, type / 3 % 3, type % 3 };
+
+        // distance of the 3 vertices from the plane, 0 for the ones on the plane
+        std::array<coord_type, 3> dist;
+        for (size_type c = 0; c < 3; c++)
         {
-          sign(distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i  , indices)))),
-          sign(distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i+1, indices)))),
-          sign(distance(plane, vertex_traits<vertex_type>::getPosition(getVertIndex(i+2, indices))))
-        };
+          dist[c] = (side[c] == 1) ? 0 : normal[0] * positions.corners[3*c  ][first + t]
+                                       + normal[1] * positions.corners[3*c+1][first + t]
+                                       + normal[2] * positions.corners[3*c+2][first + t] - offset;
+        }
 
-        switch (splitType(side[0], side[1], side[2]))
-        {
-          case splitType(-1, -1, -1):
-          case splitType(-1, -1,  0):
-          case splitType(-1,  0, -1):
-          case splitType(-1,  0,  0):
-          case splitType( 0, -1, -1):
-          case splitType( 0, -1,  0):
-          case splitType( 0,  0, -1):
-            behind++;
-            break;
-
-          case splitType( 0,  0,  1):
-          case splitType( 0,  1,  0):
-          case splitType( 0,  1,  1):
-          case splitType( 1,  0,  0):
-          case splitType( 1,  0,  1):
-          case splitType( 1,  1,  0):
-          case splitType( 1,  1,  1):
-            infront++;
-            break;
-
-          default:
-          case splitType( 0,  0,  0):
-            break;
-
-          case splitType(-1, -1,  1):
-          case splitType(-1,  1, -1):
-          case splitType( 1, -1, -1):
-            behind += 2;
-            infront++;
-            break;
-
-          case splitType(-1,  0,  1):
-          case splitType( 1,  0, -1):
-          case splitType(-1,  1,  0):
-          case splitType( 1, -1,  0):
-          case splitType( 0, -1,  1):
-          case splitType( 0,  1, -1):
-            behind++;
-            infront++;
-            break;
-
-          case splitType(-1,  1,  1):
-          case splitType( 1, -1,  1):
-          case splitType( 1,  1, -1):
-            behind++;
-            infront += 2;
-            break;
-        }
-      }
-
-      return std::make_tuple(behind, infront);
-    }
-
-    // create the bsp tree for the triangles given in the indices vector, it returns the
-    // pointer to the root of the tree
-    // the function chooses a cutting plane and recursively recursively calls itself with
-    // the lists of triangles that are behind and in front of the choosen plane
-    std::unique_ptr<Node> makeTree(const I & indices)
+        // the piece of the vertex alone on its side is a triangle, that is scaled down along both
+        // of its edges by the position of the cut, or by 1 along the edge to a vertex on the plane
+        size_type lone = 0;
+        while (side[lone] == 1 || std::ranges::count(side, side[lone]) > 1) lone++;
+        double part = 1;
+        for (size_type c = 0; c < 3; c++)
+        {
+          if (c != lone) part *= dist[lone] / (dist[lone] - dist[c]);
+        }
+
+        if (part < options_.sliverRatio)
+        {
+          side[lone] = 1;
+        }
+        else if (1 - part < options_.sliverRatio)
+        {
+          for (size_type & s : side) if (s != side[lone]) s = 1;
+        }
+        types[t] = std::uint8_t(splitType(side[0], side[1], side[2]));
+      }
+    }
+
+    // number of triangles separated by one task
+    static constexpr size_type separateChunkSize = 4096;
+
+    // a range of triangles separated by one task, first with the number of triangles and cut edges
+    // it outputs, then with the offsets of its output in the output of all chunks
+    struct SeparateChunk
     {
-      if (container_traits<I>::getSize(indices) > 3)
-      {
-        size_type bestIndex = 0;
-        Pivot bestPivot;
+      size_type first = 0, last = 0;
+      size_type behind = 0, infront = 0, onPlane = 0, cutEdges = 0, split = 0;
+    };
 
-        { // find a good pivot element
-#ifdef PRINT_LOG
-          std::cout << "Start: " << std::format("{:%d/%m/%Y %H:%M:%S}", std::chrono::system_clock::now()) << std::endl;
-#endif
+    // group of no triangle, for planes that are not the plane of a pivot triangle
+    static constexpr size_type noGroup = std::numeric_limits<size_type>::max();
+
+    // change the types of the triangles [first, first + count) that are put on the plane whatever
+    // their position: triangles in the coplanar group pivotGroup are put on the plane even when they
+    // are a little off, so they are not split into slivers, degenerated triangles cover nothing and
+    // are put on the plane as well instead of being split over and over
+    static void forceOnPlane(const Triangles & triangles, const std::vector<size_type> & groups, size_type pivotGroup,
+                             size_type first, size_type count, std::uint8_t * types) noexcept
+    {
+      for (size_type t = 0; t < count; t++)
+      {
+        if ((pivotGroup != noGroup && groups[first + t] == pivotGroup) || degenerated(triangles.planes[first + t]))
+        {
+          types[t] = std::uint8_t(splitType(1, 1, 1));
+        }
+      }
+    }
 
-          std::vector<std::pair<Pivot, size_type>> pivots(container_traits<I>::getSize(indices) / 3);
+    // separate the triangles into the 3 lists of triangles that are behind, infront and on the
+    // given plane
+    // when needed triangles are split and the smaller triangles are added to the proper lists
+    // the triangles of the group pivotGroup and degenerated triangles are put on the plane, see forceOnPlane
+    // return the number of triangles that were split, and of the vertices that were created
+    std::pair<size_type, size_type> separateTriangles(const Plane & plane, const Triangles & triangles, const TrianglePositions<coord_type> & positions,
+                           const std::vector<size_type> & groups, size_type pivotGroup, Triangles & behind, Triangles & infront, I & onPlane)
+    {
+      const I & indices = triangles.indices;
+      const std::array<coord_type, 3> planeNormal = normalCoordinates(plane);
+
+      // the triangles are separated in chunks by parallel tasks, a first pass classifies the triangles
+      // of each chunk and counts its output, so the next passes reuse the classification and write
+      // the output straight to its place in the preallocated output
+      const size_type count = positions.size();
+      std::vector<std::uint8_t> types(count);
+      std::vector<SeparateChunk> chunks((count + separateChunkSize - 1) / separateChunkSize);
+      std::for_each(EXECUTION_PAR chunks.begin(), chunks.end(),
+        [this, &triangles, &positions, &groups, &planeNormal, &plane, &types, pivotGroup, count, first = chunks.data()](SeparateChunk & chunk)
+        {
+          chunk.first = size_type(&chunk - first) * separateChunkSize;
+          chunk.last = std::min(chunk.first + separateChunkSize, count);
+
+          std::uint8_t * chunkTypes = types.data() + chunk.first;
+          classifyTriangles(positions, chunk.first, chunk.last - chunk.first, planeNormal, offset(plane), planeEpsilon_, chunkTypes);
+          suppressSlivers(positions, chunk.first, chunk.last - chunk.first, planeNormal, offset(plane), chunkTypes);
+          forceOnPlane(triangles, groups, pivotGroup, chunk.first, chunk.last - chunk.first, chunkTypes);
+
+          for (size_type t = chunk.first; t < chunk.last; t++)
+          {
+            const size_type type = types[t];
+            const std::array<size_type, 3> side { type / 9, type / 3 % 3, type % 3 };
+            chunk.behind += splitCounts[type][0];
+            chunk.infront += splitCounts[type][1];
+            chunk.onPlane += (splitCounts[type][0] + splitCounts[type][1] == 0) ? 1 : 0;
+            chunk.cutEdges += size_type(crosses(side[0], side[1])) + crosses(side[1], side[2]) + crosses(side[2], side[0]);
+            chunk.split += (splitCounts[type][0] + splitCounts[type][1] > 1) ? 1 : 0;
+          }
+        }
+      );
 
-          { // parallelize all pivot evaluations
-            auto stridedIndices = std::views::iota(size_type(0), container_traits<I>::getSize(indices)) | std::views::stride(3);
-            std::transform(EXECUTION_PAR stridedIndices.cbegin(), stridedIndices.cend(), pivots.begin(),
-              [this, &indices](size_type i) -> decltype(pivots)::value_type
+      // turn the counts into offsets and make room for the output
+      SeparateChunk total;
+      for (SeparateChunk & chunk : chunks)
+      {
+        chunk.behind = std::exchange(total.behind, total.behind + chunk.behind);
+        chunk.infront = std::exchange(total.infront, total.infront + chunk.infront);
+        chunk.onPlane = std::exchange(total.onPlane, total.onPlane + chunk.onPlane);
+        chunk.cutEdges = std::exchange(total.cutEdges, total.cutEdges + chunk.cutEdges);
+        total.split += chunk.split;
+      }
+      resize(behind, total.behind);
+      resize(infront, total.infront);
+      container_traits<I>::resize(onPlane, 3 * total.onPlane);
+
+      // if necessary create intermediate points for triangle
+      // edges that cross the plane
+      // the new points will be on the plane and will be new
+      // vertices for new triangles
+      // first collect the edges that cross the plane, an edge shared by 2 triangles
+      // is collected twice but only gets one intermediate point
+      std::vector<CutEdge> cutEdges(total.cutEdges);
+      std::for_each(EXECUTION_PAR chunks.begin(), chunks.end(),
+        [this, &indices, &types, &positions, &planeNormal, &plane, &cutEdges](const SeparateChunk & chunk)
+        {
+          size_type next = chunk.cutEdges;
+          for (size_type t = chunk.first; t < chunk.last; t++)
+          {
+            const size_type type = types[t];
+            if (splitCounts[type][0] + splitCounts[type][1] < 2) continue;
+
+            // sides of the 3 vertices, 0 behind, 1 on and 2 in front of the plane
+            const std::array<size_type, 3> side { type / 9, type / 3 % 3, type % 3 };
+
+            // distance of the 3 vertices from the choosen partitioning plane
+            std::array<coord_type, 3> dist;
+            for (size_type c = 0; c < 3; c++)
+            {
+              dist[c] = planeNormal[0] * positions.corners[3*c  ][t]
+                      + planeNormal[1] * positions.corners[3*c+1][t]
+                      + planeNormal[2] * positions.corners[3*c+2][t] - offset(plane);
+            }
+
+            for (size_type e = 0; e < 3; e++)
+            {
+              const size_type f = (e + 1) % 3;
+              if (crosses(side[e], side[f]))
               {
-                return std::make_pair(evaluatePivot(i, indices), i);
+                cutEdges[next++] = cutEdge(get(indices, 3*t+e), get(indices, 3*t+f), dist[e], dist[f]);
               }
-            );
-
-            std::sort(EXECUTION_PAR pivots.begin(), pivots.end(), PivotCompare{});
+            }
           }
-
-          bestPivot = pivots.begin()->first;
-          bestIndex = pivots.begin()->second;
         }
+      );
 
-        // create the node for this part of the tree
-        auto node = std::make_unique<Node>();
-
-        // container for the triangle indices for the triangles in front and behind the plane
-        I behind, infront;
-        container_traits<I>::reserve(behind, std::get<0>(bestPivot));
-        container_traits<I>::reserve(infront, std::get<1>(bestPivot));
+      std::sort(EXECUTION_PAR cutEdges.begin(), cutEdges.end());
+      cutEdges.erase(std::unique(EXECUTION_PAR cutEdges.begin(), cutEdges.end()), cutEdges.end());
+
+      // the intermediate points are first created in a container of their own and then appended to
+      // vertices_ at once, so parallel builds of other subtrees only wait for the append, the point of
+      // the k-th cut edge is the k-th created vertex
+      // each task locks the vertices for itself, a thread waiting for the tasks while holding the
+      // lock could run a task of another subtree that appends to the vertices and never returns
+      C created;
+      container_traits<C>::resize(created, cutEdges.size());
+      std::vector<SeparateChunk> edgeChunks((cutEdges.size() + separateChunkSize - 1) / separateChunkSize);
+      std::for_each(EXECUTION_PAR edgeChunks.begin(), edgeChunks.end(),
+        [this, &cutEdges, &created, first = edgeChunks.data()](SeparateChunk & chunk)
+        {
+          chunk.first = size_type(&chunk - first) * separateChunkSize;
+          chunk.last = std::min(chunk.first + separateChunkSize, cutEdges.size());
+
+          std::shared_lock lock(verticesMutex_);
+          for (size_type k = chunk.first; k < chunk.last; k++)
+          {
+            const CutEdge & edge = cutEdges[k];
+            container_traits<C>::set(created, k, vertex_traits<vertex_type>::getInterpolatedVertex(
+              get(vertices_, edge.a), get(vertices_, edge.b), relation(edge.da, edge.db)));
+          }
+        }
+      );
 
-        // sort the triangles into the 3 containers
-        node->plane = separateTriangles(bestIndex, indices, behind, infront, node->triangles);
+      // make the intermediate points part of the vertices
+      size_type base;
+      {
+        std::unique_lock lock(verticesMutex_);
+        base = container_traits<C>::getSize(vertices_);
+        container_traits<C>::append(vertices_, created);
+      }
 
-#ifdef PRINT_LOG
-        std::cout << "End: " << std::format("{:%d/%m/%Y %H:%M:%S}", std::chrono::system_clock::now())
-          << ", best " << bestIndex
-          << ", from " << indices.size()
-          << ", remaining " << (behind.size() + infront.size())
-          << ", on " << node->triangles.size()
-          << ", behind " << behind.size()
-          << ", infront " << infront.size()
-          << std::endl;
-#endif
+      // go over all triangles and separate them
+      std::for_each(EXECUTION_PAR chunks.begin(), chunks.end(),
+        [this, &indices, &triangles, &types, &cutEdges, base, &behind, &infront, &onPlane](const SeparateChunk & chunk)
+        {
+          // the next triangle to write for each output
+          size_type nb = chunk.behind, nf = chunk.infront, no = chunk.onPlane;
+
+          for (size_type i = 3 * chunk.first; i < 3 * chunk.last; i+=3)
+          {
+            const size_type type = types[i / 3];
+            const Plane & trianglePlane = triangles.planes[i / 3];
+
+            // the intermediate points of the edges that cross the plane
+            std::array<index_type, 3> A;
+            if (splitCounts[type][0] + splitCounts[type][1] > 1)
+            {
+              const std::array<size_type, 3> side { type / 9, type / 3 % 3, type % 3 };
+              for (size_type e = 0; e < 3; e++)
+              {
+                const size_type f = (e + 1) % 3;
+                if (crosses(side[e], side[f]))
+                {
+                  const CutEdge edge = cutEdge(get(indices, i+e), get(indices, i+f), 0, 0);
+                  A[e] = index_type(base + (std::lower_bound(cutEdges.begin(), cutEdges.end(), edge) - cutEdges.begin()));
+                }
+              }
+            }
+
+            // go over all possible positions of the 3 vertices relative to the plane
+            switch (type)
+            {
+              // all point on one side of the plane (or on the plane)
+              // in this case we simply add the complete triangle
+              // to the proper halve of the subtree
+              case splitType(0, 0, 0):
+              case splitType(0, 0, 1):
+              case splitType(0, 1, 0):
+              case splitType(0, 1, 1):
+              case splitType(1, 0, 0):
+              case splitType(1, 0, 1):
+              case splitType(1, 1, 0):
+                set(behind, nb++, get(indices, i), get(indices, i+1), get(indices, i+2), trianglePlane);
+                break;
+
+              case splitType(1, 1, 2):
+              case splitType(1, 2, 1):
+              case splitType(1, 2, 2):
+              case splitType(2, 1, 1):
+              case splitType(2, 1, 2):
+              case splitType(2, 2, 1):
+              case splitType(2, 2, 2):
+                set(infront, nf++, get(indices, i  ), get(indices, i+1), get(indices, i+2), trianglePlane);
+                break;
+
+              // triangle on the dividing plane
+              default:
+              case splitType(1, 1, 1):
+                set(onPlane, no++, get(indices, i  ), get(indices, i+1), get(indices, i+2));
+                break;
+
+              // and now all the ways that the triangle can be cut by the plane
+              case splitType(2, 0, 1):
+                set(behind,  nb++, get(indices, i+1), get(indices, i+2), A[0], trianglePlane);
+                set(infront, nf++, get(indices, i+2), get(indices, i+0), A[0], trianglePlane);
+                break;
+
+              case splitType(0, 1, 2):
+                set(behind,  nb++, get(indices, i+0), get(indices, i+1), A[2], trianglePlane);
+                set(infront, nf++, get(indices, i+1), get(indices, i+2), A[2], trianglePlane);
+                break;
+
+              case splitType(1, 2, 0):
+                set(behind,  nb++, get(indices, i+2), get(indices, i+0), A[1], trianglePlane);
+                set(infront, nf++, get(indices, i+0), get(indices, i+1), A[1], trianglePlane);
+                break;
+
+              case splitType(0, 2, 1):
+                set(behind,  nb++, get(indices, i+2), get(indices, i+0), A[0], trianglePlane);
+                set(infront, nf++, get(indices, i+1), get(indices, i+2), A[0], trianglePlane);
+                break;
+
+              case splitType(2, 1, 0):
+                set(behind,  nb++, get(indices, i+1), get(indices, i+2), A[2], trianglePlane);
+                set(infront, nf++, get(indices, i+0), get(indices, i+1), A[2], trianglePlane);
+                break;
+
+              case splitType(1, 0, 2):
+                set(behind,  nb++, get(indices, i+0), get(indices, i+1), A[1], trianglePlane);
+                set(infront, nf++, get(indices, i+2), get(indices, i+0), A[1], trianglePlane);
+                break;
+
+              case splitType(2, 0, 0):
+                set(infront, nf++, get(indices, i+0), A[0],              A[2], trianglePlane);
+                set(behind,  nb++, get(indices, i+1), A[2],              A[0], trianglePlane);
+                set(behind,  nb++, get(indices, i+1), get(indices, i+2), A[2], trianglePlane);
+                break;
+
+              case splitType(0, 2, 0):
+                set(infront, nf++, get(indices, i+1), A[1],              A[0], trianglePlane);
+                set(behind,  nb++, get(indices, i+2), A[0],              A[1], trianglePlane);
+                set(behind,  nb++, get(indices, i+2), get(indices, i+0), A[0], trianglePlane);
+                break;
+
+              case splitType(0, 0, 2):
+                set(infront, nf++, get(indices, i+2), A[2],              A[1], trianglePlane);
+                set(behind,  nb++, get(indices, i+0), A[1],              A[2], trianglePlane);
+                set(behind,  nb++, get(indices, i+0), get(indices, i+1), A[1], trianglePlane);
+                break;
+
+              case splitType(0, 2, 2):
+                set(behind,  nb++, get(indices, i+0), A[0],              A[2], trianglePlane);
+                set(infront, nf++, get(indices, i+1), A[2],              A[0], trianglePlane);
+                set(infront, nf++, get(indices, i+1), get(indices, i+2), A[2], trianglePlane);
+                break;
+
+              case splitType(2, 0, 2):
+                set(behind,  nb++, get(indices, i+1), A[1],              A[0], trianglePlane);
+                set(infront, nf++, get(indices, i+0), A[0],              A[1], trianglePlane);
+                set(infront, nf++, get(indices, i+2), get(indices, i+0), A[1], trianglePlane);
+                break;
+
+              case splitType(2, 2, 0):
+                set(behind,  nb++, get(indices, i+2), A[2],              A[1], trianglePlane);
+                set(infront, nf++, get(indices, i+0), A[1],              A[2], trianglePlane);
+                set(infront, nf++, get(indices, i+0), get(indices, i+1), A[1], trianglePlane);
+                break;
+
+            }
+          }
+        }
+      );
 
-        node->behind = makeTree(behind);
-        node->infront = makeTree(infront);
+      return { total.split, cutEdges.size() };
+    }
 
-        return node;
-      }
-      else if (container_traits<I>::getSize(indices) == 3)
+    // number of candidate pivots to score for a node with the given number of triangles
+    size_type candidateCount(size_type triangles) const noexcept
+    {
+      size_type count = triangles;
+      if (options_.pivotSamples > 0)
       {
-        // create the last node for this part of the tree
-        // special case if epsilon is too small
-        auto node = std::make_unique<Node>();
-        node->plane = separateTriangles(0, indices, node->triangles, node->triangles, node->triangles);
-        return node;
+        count = std::min(count, size_type(options_.pivotSamples));
       }
-      else
+      if (options_.pivotSampleRatio < 1)
       {
-        // this tree is empty, return nullptr
-        return std::unique_ptr<Node>();
+        count = std::min(count, size_type(std::ceil(options_.pivotSampleRatio * triangles)));
       }
+      return std::max(count, size_type(1));
     }
 
-    // sort the triangles in the tree into the out container so that triangles far from p are
-    // in front of the output vector
-    void sortBackToFront(const point_type & p, const Node * n, I & out) const
+    // triangle of the j-th out of count candidate pivots, the triangles are divided into count
+    // strata of the same size and one pseudo random triangle is taken out of each stratum, so the
+    // candidates are spread over the whole node and the build stays reproducible
+    static size_type candidateTriangle(size_type j, size_type count, size_type triangles) noexcept
     {
-      if (!n) return;
+      const size_type first = j * triangles / count;
+      const size_type stratum = (j + 1) * triangles / count - first;
+      if (stratum <= 1) return first;
+
+      // splitmix64 hash of the stratum
+      std::uint64_t h = std::uint64_t(j) + std::uint64_t(triangles) * 0x9e3779b97f4a7c15ull;
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+      h ^= h >> 31;
 
-      if (distance(n->plane, p) < 0)
+      return first + size_type(h % stratum);
+    }
+
+    // plane quantized to a grid of epsilon, coplanar triangles have the same key
+    typedef std::array<std::int64_t, 4> PlaneKey;
+    struct PlaneKeyHash
+    {
+      std::size_t operator()(const PlaneKey & key) const noexcept
       {
-        sortBackToFront(p, n->infront.get(), out);
-        container_traits<I>::append(out, n->triangles);
-        sortBackToFront(p, n->behind.get(), out);
+        std::size_t h = 0;
+        for (std::int64_t k : key) h = (h ^ std::hash<std::int64_t>{}(k)) * 0x100000001b3ull;
+        return h;
       }
-      else
+    };
+
+    // degenerated triangles have a null normal, see calculatePlane
+    static bool degenerated(const Plane & plane) noexcept
+    {
+      return point_traits<point_type>::coordinate(normal(plane), 0) == 0
+          && point_traits<point_type>::coordinate(normal(plane), 1) == 0
+          && point_traits<point_type>::coordinate(normal(plane), 2) == 0;
+    }
+
+    // the key of the plane, both orientations of a plane have the same key, degenerated
+    // triangles have a null normal and no key
+    static std::optional<PlaneKey> planeKey(const Plane & plane) noexcept
+    {
+      std::array<coord_type, 4> values {
+        point_traits<point_type>::coordinate(normal(plane), 0),
+        point_traits<point_type>::coordinate(normal(plane), 1),
+        point_traits<point_type>::coordinate(normal(plane), 2),
+        offset(plane)
+      };
+      if (degenerated(plane)) return std::nullopt;
+
+      PlaneKey key;
+      for (size_type v = 0; v < 4; v++)
       {
-        sortBackToFront(p, n->behind.get(), out);
-        container_traits<I>::append(out, n->triangles);
-        sortBackToFront(p, n->infront.get(), out);
+        key[v] = std::llround(values[v] / epsilon());
       }
-    }
 
-  public:
+      // orient the plane so that its first not null normal coordinate is positive
+      const auto first = std::ranges::find_if(key.begin(), key.begin() + 3, [](std::int64_t k) { return k != 0; });
+      if (first != key.begin() + 3 && *first < 0)
+      {
+        for (std::int64_t & k : key) k = -k;
+      }
 
-    /// construct the tree, vertices are taken over, indices not
-    /// the tree is constructed in such a way that the least number
-    /// of triangles need to be split, if there is a way to build this
-    /// tree without splitting, it will be found
-    /// \param vertices, container with vertices, will be taken over and
-    ///        new vertices appended, when necessary
-    /// \param indices, container with indices into the vertices, each group of
-    ///        3 corresponds to one triangle
-    BspTree(C && vertices, const I & indices) : vertices_(std::move(vertices))
-    {
-      root_ = makeTree(indices);
+      return key;
     }
 
-    /// another constructor that assumes that the vertices given are grouped in
-    /// triples that each represents one triangle
-    BspTree(C && vertices) : vertices_(std::move(vertices))
+    // group the coplanar triangles, returns for every triangle the index of the first triangle
+    // that has the same plane, or noGroup for a degenerated triangle
+    static std::vector<size_type> groupCoplanar(const Triangles & triangles)
     {
-      I indices;
+      std::vector<size_type> groups(triangles.planes.size());
+      std::unordered_map<PlaneKey, size_type, PlaneKeyHash> firsts;
+      firsts.reserve(triangles.planes.size());
 
-      for (size_type i = 0; i < container_traits<C>::getSize(vertices_); i++)
+      for (size_type t = 0; t < groups.size(); t++)
       {
-        container_traits<I>::append(indices, i);
+        const std::optional<PlaneKey> key = planeKey(triangles.planes[t]);
+        groups[t] = key ? firsts.try_emplace(*key, t).first->second : noGroup;
       }
 
-      root_ = makeTree(indices);
+      return groups;
     }
 
-    /// get the vertex container
-    const C & getVertices() const noexcept { return vertices_; }
+    typedef std::tuple<size_type, size_type, size_type> Pivot; // pivot type (number behind, number infront, number on the plane)
+    // candidate pivot, the counts of the pivot triangle, which are not scored when its evaluation
+    // was cut short because it could not become the best one anymore, and the index of the pivot
+    // triangle, no candidate at all has no index
+    struct Candidate
+    {
+      Pivot pivot{};
+      bool scored = false;
+      size_type index = std::numeric_limits<size_type>::max();
 
-    /// get a container of indices for triangles so that the triangles are sorted
-    /// from back to front when viewed from the given position
-    /// \param p the point from where to look
-    /// \return container of indices into the vertex container
-    I sort(const point_type & p) const
+      Candidate() = default;
+      Candidate(const std::optional<Pivot> & p, size_type i) : pivot(p.value_or(Pivot{})), scored(p.has_value()), index(i) {}
+    };
+
+    // score of the pivots for a number of triangles, with the weights of the build options
+    struct PivotScore
     {
-      I out;
+      double split, balance, coplanar;
+      size_type triangles;
 
-      // TODO do we want to check, if the container elements are big enough?
-      sortBackToFront(p, root_.get(), out);
+      static double imbalance(const Pivot & p) noexcept
+      {
+        return std::abs(double(std::get<0>(p)) - double(std::get<1>(p)));
+      }
+
+      // score of a pivot, lower is better
+      double operator()(const Pivot & p) const noexcept
+      {
+        const auto [nb, nf, no] = p;
+        return split * (double(nb + nf + no) - double(triangles)) + balance * imbalance(p) - coplanar * double(no);
+      }
+
+      // lowest score a pivot can still get, with the counts of its first classified triangles: the
+      // other triangles do not add to the splits, may all be on the plane and may each reduce the
+      // imbalance by one
+      double lowerBound(const Pivot & p, size_type classified) const noexcept
+      {
+        const auto [nb, nf, no] = p;
+        const double remaining = double(triangles - classified);
+        return split * (double(nb + nf + no) - double(classified)) + balance * std::max(0.0, imbalance(p) - remaining)
+          - coplanar * (double(no) + remaining);
+      }
+    };
+
+    // the score of the pivots for the given number of triangles
+    PivotScore pivotScore(size_type triangles) const noexcept
+    {
+      return PivotScore{ options_.splitWeight, options_.balanceWeight, options_.coplanarWeight, triangles };
+    }
+
+    // helper to find the good pivot point
+    struct PivotCompare
+    {
+      PivotScore score;
+
+      // new pivot is better, if
+      // its score is lower
+      // or equal and the triangles more equally distributed between left and right
+      bool operator()(const Pivot & lhs, const Pivot & rhs) const
+      {
+        const double ls = score(lhs);
+        const double rs = score(rhs);
+
+        return ((ls < rs) || ((ls == rs) && (PivotScore::imbalance(lhs) < PivotScore::imbalance(rhs))));
+      }
+
+      // the better of two candidates, scored candidates win over the others, equally good
+      // ones are decided by the lower index so the choice does not depend on the evaluation order
+      Candidate operator()(const Candidate & lhs, const Candidate & rhs) const
+      {
+        if (lhs.scored != rhs.scored)
+        {
+          return lhs.scored ? lhs : rhs;
+        }
+        if (lhs.scored && (*this)(lhs.pivot, rhs.pivot)) return lhs;
+        if (lhs.scored && (*this)(rhs.pivot, lhs.pivot)) return rhs;
+        return (lhs.index < rhs.index) ? lhs : rhs;
+      }
+    };
+
+    // check what would happen if the plane of a pivot is used as a cutting plane for the triangles in positions
+    // returns the number of triangles that would end up behind it, in front of it and on it, the way
+    // separateTriangles puts them, with the triangles of the group pivotGroup on the plane
+    // the evaluation stops and returns nothing as soon as the pivot cannot get a score below bound anymore,
+    // bound holds the score of the best pivot found so far and may decrease while evaluating
+    std::optional<Pivot> evaluatePivot(const Plane & plane, const Triangles & triangles, const TrianglePositions<coord_type> & positions,
+                                       const std::vector<size_type> & groups, size_type pivotGroup,
+                                       const PivotScore & score, const std::atomic<double> & bound) const noexcept
+    {
+      // number of triangles classified at once, the bound is checked after each batch
+      constexpr size_type batchSize = 64;
+
+      size_type behind = 0;
+      size_type infront = 0;
+      size_type onPlane = 0;
+
+      // count how many triangles would need to be cut, would lie behind and in front of the plane
+      const std::array<coord_type, 3> planeNormal = normalCoordinates(plane);
+
+      // this is a simplification of the algorithm above to just count the numbers of triangles
+      std::array<std::uint8_t, batchSize> types;
+      for (size_type first = 0; first < positions.size(); first += batchSize)
+      {
+        const size_type count = std::min(batchSize, positions.size() - first);
+        classifyTriangles(positions, first, count, planeNormal, offset(plane), planeEpsilon_, types.data());
+        suppressSlivers(positions, first, count, planeNormal, offset(plane), types.data());
+        forceOnPlane(triangles, groups, pivotGroup, first, count, types.data());
+
+        for (size_type t = 0; t < count; t++)
+        {
+          behind += splitCounts[types[t]][0];
+          infront += splitCounts[types[t]][1];
+          onPlane += (types[t] == splitType(1, 1, 1)) ? 1 : 0;
+        }
+
+        // this pivot cannot win anymore
+        if (score.lowerBound(std::make_tuple(behind, infront, onPlane), first + count) > bound.load(std::memory_order_relaxed)) return std::nullopt;
+      }
+
+      return std::make_tuple(behind, infront, onPlane);
+    }
+
+    // the axis where the triangle centroids spread the most, with the centroids along that axis,
+    // 3 times as big, which does not change their order
+    std::pair<size_type, std::vector<coord_type>> longestAxis(const TrianglePositions<coord_type> & positions) const
+    {
+      const size_type count = positions.size();
+
+      std::array<std::vector<coord_type>, 3> centroids;
+      std::array<coord_type, 3> extent { 0, 0, 0 };
+      for (size_type axis = 0; axis < 3; axis++)
+      {
+        centroids[axis].resize(count);
+        for (size_type t = 0; t < count; t++)
+        {
+          centroids[axis][t] = positions.corners[axis][t] + positions.corners[3 + axis][t] + positions.corners[6 + axis][t];
+        }
+        if (count == 0) continue;
+        const auto [low, high] = std::ranges::minmax_element(centroids[axis]);
+        extent[axis] = *high - *low;
+      }
+
+      const size_type axis = size_type(std::ranges::max_element(extent) - extent.begin());
+      return { axis, std::move(centroids[axis]) };
+    }
+
+    // the plane with the normal along axis at the given centroid, 3 times as big
+    static Plane axisPlane(size_type axis, coord_type centroid)
+    {
+      const std::array<coord_type, 3> n { coord_type(axis == 0), coord_type(axis == 1), coord_type(axis == 2) };
+      return std::make_tuple(point_traits<point_type>::make(n[0], n[1], n[2]), centroid / 3);
+    }
+
+    // the axis aligned plane through the median of the triangle centroids along the axis where they
+    // spread the most, when the triangles are many enough to be split this way, or always in a tree
+    // over clusters, and when both sides of the plane get less triangles
+    std::optional<Plane> axisAlignedPlane(const Triangles & triangles, const TrianglePositions<coord_type> & positions) const
+    {
+      const size_type count = positions.size();
+      if (options_.clusterSize == 0 && (options_.axisSplitAbove == 0 || count <= options_.axisSplitAbove)) return std::nullopt;
+
+      auto [axis, values] = longestAxis(positions);
+      const auto [low, high] = std::ranges::minmax_element(values);
+      if (*high - *low <= 0) return std::nullopt;
+
+      std::nth_element(values.begin(), values.begin() + count / 2, values.end());
+      const Plane plane = axisPlane(axis, values[count / 2]);
+
+      // triangles across the plane go to both sides, so make sure that the split makes progress
+      const std::atomic<double> bound = std::numeric_limits<double>::infinity();
+      const Pivot sides = *evaluatePivot(plane, triangles, positions, {}, noGroup, pivotScore(count), bound);
+      if (std::max(std::get<0>(sides), std::get<1>(sides)) >= count) return std::nullopt;
+
+      return plane;
+    }
+
+    // make node the child of the parent of slot, nothing to do for the root that is always the first node
+    void linkNode(const Slot & slot, node_index node) noexcept
+    {
+      if (slot.parent != noNode)
+      {
+        (slot.infront ? nodes_[slot.parent].infront : nodes_[slot.parent].behind) = node;
+      }
+    }
+
+    // make node n a leaf bucket, or a cluster with the given orders
+    void setLeaf(node_index n, std::uint32_t orders)
+    {
+      if (leaves_.size() <= n) leaves_.resize(size_type(n) + 1, notLeaf);
+      leaves_[n] = orders;
+    }
+
+    // notLeaf when node n is not a leaf, noOrders for a leaf bucket, or the orders of a cluster
+    std::uint32_t leafOf(node_index n) const noexcept
+    {
+      return (n < leaves_.size()) ? leaves_[n] : notLeaf;
+    }
+
+    // append a node with the given plane and triangles to the tree at slot, a cluster also
+    // gets its orders, one for each of the clusterDirections
+    // the subtree at slot is built with this node, the subtrees behind and infront of it are the
+    // ones left to build below it
+    node_index addNode(const Slot & slot, const Plane & plane, const I & onPlane, bool leaf = false, const std::uint8_t * orders = nullptr,
+                       const Triangles * behind = nullptr, const Triangles * infront = nullptr)
+    {
+      std::unique_lock lock(nodesMutex_);
+
+      const node_index node = node_index(nodes_.size());
+      nodes_.push_back(Node{ plane, std::uint32_t(container_traits<I>::getSize(triangles_)), std::uint32_t(container_traits<I>::getSize(onPlane)) });
+      container_traits<I>::append(triangles_, onPlane);
+      if (orders)
+      {
+        setLeaf(node, std::uint32_t(clusterOrders_.size()));
+        clusterOrders_.insert(clusterOrders_.end(), orders, orders + clusterDirections.size() * container_traits<I>::getSize(onPlane) / 3);
+      }
+      else if (leaf)
+      {
+        setLeaf(node, noOrders);
+      }
+      linkNode(slot, node);
+
+      unbuilt_.erase(slot);
+      if (behind && container_traits<I>::getSize(behind->indices) > 0) unbuilt_.emplace(slot.child(node, false), behind);
+      if (infront && container_traits<I>::getSize(infront->indices) > 0) unbuilt_.emplace(slot.child(node, true), infront);
+
+      return node;
+    }
+
+    // the first index of the best pivot triangle among the candidates, the first triangles of the
+    // coplanar groups in uniquePlanes, each candidate is scored with all triangles of its group on the
+    // plane, as the node of the pivot gets them, all candidates are evaluated in parallel and each
+    // evaluation stops once its pivot cannot beat the best one found so far, which does not change the choice
+    size_type choosePivot(const Triangles & triangles, const TrianglePositions<coord_type> & positions,
+                          const std::vector<size_type> & groups, const std::vector<size_type> & uniquePlanes) const
+    {
+      const size_type planes = uniquePlanes.size();
+      const size_type candidates = candidateCount(planes);
+
+      // score of the best pivot evaluated so far, shared by all evaluations to stop early
+      const PivotScore score = pivotScore(container_traits<I>::getSize(triangles.indices) / 3);
+      std::atomic<double> bestScore = std::numeric_limits<double>::infinity();
+
+      // parallelize all pivot evaluations and keep the best one
+      auto candidateIndices = std::views::iota(size_type(0), candidates);
+      const Candidate best = std::transform_reduce(EXECUTION_PAR candidateIndices.begin(), candidateIndices.end(),
+        Candidate(), PivotCompare{ score },
+        [this, &triangles, &positions, &groups, &uniquePlanes, &score, &bestScore, candidates, planes](size_type j) -> Candidate
+        {
+          const size_type t = uniquePlanes[candidateTriangle(j, candidates, planes)];
+          const std::optional<Pivot> pivot = evaluatePivot(triangles.planes[t], triangles, positions, groups, groups[t], score, bestScore);
+          if (pivot)
+          {
+            const double value = score(*pivot);
+            double current = bestScore.load(std::memory_order_relaxed);
+            while (value < current && !bestScore.compare_exchange_weak(current, value, std::memory_order_relaxed));
+          }
+          return Candidate(pivot, 3 * t);
+        }
+      );
+
+      return best.index;
+    }
+
+    // create the node for the given triangles at slot, the function chooses a cutting plane and
+    // separates the triangles into the node and the containers of the triangles behind and in front
+    // everything needed to choose the plane is freed on return
+    node_index makeNode(const Triangles & triangles, const Slot & slot, Triangles & behind, Triangles & infront, std::vector<DepthStatistics> & depths)
+    {
+      const I & indices = triangles.indices;
+      const size_type count = container_traits<I>::getSize(indices) / 3;
+
+      const auto start = std::chrono::steady_clock::now();
+
+      // positions of all triangles, shared by all evaluations and the separation
+      const TrianglePositions<coord_type> positions = gatherPositions(indices);
+
+      // the plane that splits the triangles, with the coplanar groups of the triangles and the group
+      // of the pivot triangle, whose triangles are all put on the plane
+      Plane plane;
+      std::vector<size_type> groups;
+      size_type pivotGroup = noGroup;
+
+      if (const std::optional<Plane> axisPlane = axisAlignedPlane(triangles, positions))
+      {
+        // large subtrees, and all subtrees of a tree over clusters, are split in halves first, that
+        // is much cheaper than a pivot search
+        plane = *axisPlane;
+      }
+      else
+      {
+        // coplanar triangles give the same split, so only the first triangle of each group is a candidate,
+        // degenerated triangles are none
+        groups = groupCoplanar(triangles);
+        std::vector<size_type> uniquePlanes;
+        for (size_type t = 0; t < groups.size(); t++)
+        {
+          if (groups[t] == t) uniquePlanes.push_back(t);
+        }
+        if (uniquePlanes.empty()) uniquePlanes.push_back(0);
+
+        const size_type bestIndex = choosePivot(triangles, positions, groups, uniquePlanes);
+
+        plane = triangles.planes[bestIndex / 3];
+        pivotGroup = groups[bestIndex / 3];
+      }
+
+      // sort the triangles into the 3 containers
+      const auto separation = std::chrono::steady_clock::now();
+      I onPlane;
+      const auto [split, created] = separateTriangles(plane, triangles, positions, groups, pivotGroup, behind, infront, onPlane);
+
+      // create the node for this part of the tree
+      const node_index node = addNode(slot, plane, onPlane, false, nullptr, &behind, &infront);
+
+      const auto end = std::chrono::steady_clock::now();
+      recordNode(depths, slot, DepthStatistics{ 1, 0, count, split, created,
+        std::chrono::duration<double>(separation - start).count(), std::chrono::duration<double>(end - separation).count() });
+
+      return node;
+    }
+
+    // create the cluster of the given triangles at slot, with the order of its triangles for each of
+    // the clusterDirections, sorted by their centroid along the direction, the farthest first
+    void makeCluster(const Triangles & triangles, const Slot & slot, std::vector<DepthStatistics> & depths)
+    {
+      const I & indices = triangles.indices;
+      const size_type count = container_traits<I>::getSize(indices) / 3;
+
+      const TrianglePositions<coord_type> positions = gatherPositions(indices);
+      std::vector<std::uint8_t> orders(clusterDirections.size() * count);
+      std::vector<coord_type> distances(count);
+      for (size_type d = 0; d < clusterDirections.size(); d++)
+      {
+        const auto & direction = clusterDirections[d];
+        for (size_type t = 0; t < count; t++)
+        {
+          distances[t] = 0;
+          for (size_type axis = 0; axis < 3; axis++)
+          {
+            distances[t] += coord_type(direction[axis]) * (positions.corners[axis][t] + positions.corners[3 + axis][t] + positions.corners[6 + axis][t]);
+          }
+        }
+
+        const auto order = orders.begin() + d * count;
+        std::iota(order, order + count, std::uint8_t(0));
+        std::stable_sort(order, order + count, [&distances](std::uint8_t a, std::uint8_t b) { return distances[a] > distances[b]; });
+      }
+
+      addNode(slot, Plane{}, indices, true, orders.data());
+      recordNode(depths, slot, DepthStatistics{ 1, 1, count });
+    }
+
+    // create the bsp tree for the given triangles into slot, the triangles are consumed
+    // the function chooses a cutting plane and recursively calls itself with
+    // the lists of triangles that are behind and in front of the choosen plane
+    // the statistics of the nodes are added to the depths of the calling task
+    void makeTree(Triangles && triangles, const Slot & slot, TaskGroup & tasks, std::vector<DepthStatistics> & depths)
+    {
+      const I & indices = triangles.indices;
+
+      const size_type count = container_traits<I>::getSize(indices) / 3;
+
+      if (count > 0 && count <= std::min(options_.clusterSize, maxClusterSize))
+      {
+        // small enough for a cluster, whose triangles are ordered by precomputed orders
+        makeCluster(triangles, slot, depths);
+      }
+      else if (count > 1 && isLeaf(count, slot))
+      {
+        // stop here and keep all triangles in a bucket, that is sorted when the tree is sorted
+        addNode(slot, Plane{}, indices, true);
+        recordNode(depths, slot, DepthStatistics{ 1, 1, count });
+      }
+      else if (count > 1)
+      {
+        // container for the triangles in front and behind the plane
+        Triangles behind, infront;
+        const node_index node = makeNode(triangles, slot, behind, infront, depths);
+
+        // all triangles of this subtree are in the node or in the containers of its children now, free
+        // them before building the children, so only the subtrees left to build stay in memory
+        triangles = Triangles();
+
+        makeSubtree(std::move(behind), slot.child(node, false), tasks, depths);
+        makeSubtree(std::move(infront), slot.child(node, true), tasks, depths);
+      }
+      else if (count == 1)
+      {
+        // create the last node for this part of the tree, the triangle is on its own plane
+        addNode(slot, triangles.planes[0], indices);
+        recordNode(depths, slot, DepthStatistics{ 1, 0, 1 });
+      }
+      // otherwise this tree is empty and slot stays without node
+    }
+
+    // add the node built at slot to the statistics of the depths of its task, and report the
+    // progress when a report is due
+    void recordNode(std::vector<DepthStatistics> & depths, const Slot & slot, const DepthStatistics & node)
+    {
+      if (depths.size() <= slot.depth) depths.resize(slot.depth + 1);
+      depths[slot.depth] += node;
+
+      reportProgress();
+    }
+
+    // add the statistics of the depths of a task that ended to the statistics of the build
+    void mergeStatistics(const std::vector<DepthStatistics> & depths)
+    {
+      std::lock_guard lock(statisticsMutex_);
+      if (statistics_.depths.size() < depths.size()) statistics_.depths.resize(depths.size());
+      for (size_type depth = 0; depth < depths.size(); depth++) statistics_.depths[depth] += depths[depth];
+    }
+
+    // call the progress function when a report is due, with the statistics of the tasks that ended
+    // and the nodes and subtrees left to build so far, by one thread at a time, the others go on
+    void reportProgress()
+    {
+      if (!options_.progress || options_.progressInterval <= 0) return;
+
+      std::unique_lock progressLock(progressMutex_, std::try_to_lock);
+      const auto now = std::chrono::steady_clock::now();
+      if (!progressLock.owns_lock() || now < nextProgress_) return;
+
+      BuildStatistics report;
+      {
+        std::lock_guard lock(statisticsMutex_);
+        report.depths = statistics_.depths;
+      }
+      {
+        std::shared_lock lock(nodesMutex_);
+        report.placedTriangles = (container_traits<I>::getSize(triangles_) + narrowTriangles_.size()) / 3;
+        for (const auto & [slot, triangles] : unbuilt_)
+        {
+          report.remainingTriangles += container_traits<I>::getSize(triangles->indices) / 3;
+          report.remainingSubtrees.insert(container_traits<I>::getSize(triangles->indices) / 3);
+        }
+      }
+      report.seconds = std::chrono::duration<double>(now - buildStart_).count();
+
+      options_.progress(report);
+      nextProgress_ = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.progressInterval));
+    }
+
+    // check if the subtree with the given number of triangles at slot becomes a leaf bucket
+    bool isLeaf(size_type count, const Slot & slot) const noexcept
+    {
+      return count <= options_.leafSize
+        || (options_.leafDepth > 0 && slot.depth >= options_.leafDepth)
+        || std::chrono::steady_clock::now() >= leafDeadline_;
+    }
+
+    // write a checkpoint when one is due, the first task that gets here writes it while the others
+    // go on with the nodes they are building, they only wait for the copy of the build to add a
+    // node or start a task
+    void checkpointIfDue()
+    {
+      if (!checkpoint_) return;
+
+      std::unique_lock checkpointLock(checkpointMutex_, std::try_to_lock);
+      if (!checkpointLock.owns_lock() || std::chrono::steady_clock::now() < nextCheckpoint_) return;
+
+      // the nodes and the subtrees left to build are copied together, the tasks only wait for the copy
+      Checkpoint checkpoint;
+      {
+        std::shared_lock nodesLock(nodesMutex_);
+        checkpoint.nodes = nodes_;
+        checkpoint.triangles = triangles_;
+        checkpoint.leaves = leaves_;
+        checkpoint.clusterOrders = clusterOrders_;
+        for (const auto & [slot, triangles] : unbuilt_) checkpoint.unbuilt.emplace(slot, *triangles);
+      }
+
+      // the vertices that tasks add for the nodes they are building are left out, those nodes are
+      // built again on resume, so only the vertices used by the triangles are kept
+      static constexpr size_type unused = std::numeric_limits<size_type>::max();
+      std::vector<size_type> renumbered;
+      const auto use = [this, &renumbered](const I & indices)
+        {
+          for (size_type i = 0; i < container_traits<I>::getSize(indices); i++)
+          {
+            const size_type v = get(indices, i);
+            if (renumbered.size() <= v) renumbered.resize(v + 1, unused);
+            renumbered[v] = 0;
+          }
+        };
+      use(checkpoint.triangles);
+      for (const auto & [slot, triangles] : checkpoint.unbuilt) use(triangles.indices);
+
+      size_type used = 0;
+      for (size_type & v : renumbered) if (v != unused) v = used++;
+
+      container_traits<C>::resize(checkpoint.vertices, used);
+      {
+        std::shared_lock verticesLock(verticesMutex_);
+        for (size_type v = 0; v < renumbered.size(); v++)
+        {
+          if (renumbered[v] != unused) container_traits<C>::set(checkpoint.vertices, renumbered[v], get(vertices_, v));
+        }
+      }
+
+      const auto renumber = [this, &renumbered](I & indices)
+        {
+          for (size_type i = 0; i < container_traits<I>::getSize(indices); i++)
+          {
+            container_traits<I>::set(indices, i, index_type(renumbered[get(indices, i)]));
+          }
+        };
+      renumber(checkpoint.triangles);
+      for (auto & [slot, triangles] : checkpoint.unbuilt) renumber(triangles.indices);
+
+      checkpoint_(std::move(checkpoint));
+
+      nextCheckpoint_ = std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.checkpointInterval));
+    }
+
+    // create the bsp tree for the given triangles into slot, large trees are built
+    // by a task of their own so subtrees are built in parallel
+    // the statistics of the subtrees built by this task are added to depths
+    void makeSubtree(Triangles && triangles, const Slot & slot, TaskGroup & tasks, std::vector<DepthStatistics> & depths)
+    {
+      checkpointIfDue();
+
+      if (container_traits<I>::getSize(triangles.indices) / 3 >= options_.parallelCutoff)
+      {
+        // the task can only be called as const, so it owns the triangles through a pointer to consume them,
+        // they move there while no checkpoint reads them
+        auto subtree = std::make_shared<Triangles>();
+        {
+          std::unique_lock lock(nodesMutex_);
+          *subtree = std::move(triangles);
+          if (const auto unbuilt = unbuilt_.find(slot); unbuilt != unbuilt_.end()) unbuilt->second = subtree.get();
+        }
+        tasks.run([this, subtree, slot, &tasks]()
+        {
+          std::vector<DepthStatistics> taskDepths;
+          makeTree(std::move(*subtree), slot, tasks, taskDepths);
+          mergeStatistics(taskDepths);
+        });
+      }
+      else
+      {
+        makeTree(std::move(triangles), slot, tasks, depths);
+      }
+    }
+
+    // build the subtrees in pending_, when a checkpoint function is given it is called every
+    // options_.checkpointInterval seconds with the nodes built so far and the subtrees left to build
+    void buildPending(const std::function<void(Checkpoint &&)> & checkpoint = {})
+    {
+      // vertices within a part of the size of the model are on the plane
+      planeEpsilon_ = epsilon();
+      if (options_.snapTolerance > 0 && container_traits<C>::getSize(vertices_) > 0)
+      {
+        std::array<coord_type, 3> low, high;
+        low.fill(std::numeric_limits<coord_type>::max());
+        high.fill(std::numeric_limits<coord_type>::lowest());
+        for (size_type v = 0; v < container_traits<C>::getSize(vertices_); v++)
+        {
+          const point_type p = vertex_traits<vertex_type>::getPosition(get(vertices_, v));
+          for (size_type axis = 0; axis < 3; axis++)
+          {
+            low[axis] = std::min(low[axis], point_traits<point_type>::coordinate(p, axis));
+            high[axis] = std::max(high[axis], point_traits<point_type>::coordinate(p, axis));
+          }
+        }
+        const coord_type diagonal = std::sqrt((high[0] - low[0]) * (high[0] - low[0])
+                                            + (high[1] - low[1]) * (high[1] - low[1])
+                                            + (high[2] - low[2]) * (high[2] - low[2]));
+        planeEpsilon_ = std::max(planeEpsilon_, coord_type(options_.snapTolerance * diagonal));
+      }
+
+      checkpoint_ = (options_.checkpointInterval > 0) ? checkpoint : std::function<void(Checkpoint &&)>();
+      buildStart_ = std::chrono::steady_clock::now();
+      nextProgress_ = buildStart_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.progressInterval));
+      statistics_ = BuildStatistics();
+
+      leafDeadline_ = (options_.leafAfter > 0)
+        ? buildStart_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.leafAfter))
+        : std::chrono::steady_clock::time_point::max();
+
+      std::vector<PendingTree> pending = std::exchange(pending_, {});
+      unbuilt_.clear();
+      for (const PendingTree & tree : pending)
+      {
+        if (container_traits<I>::getSize(tree.triangles.indices) > 0) unbuilt_.emplace(tree.slot, &tree.triangles);
+      }
+      nextCheckpoint_ = buildStart_
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options_.checkpointInterval));
+
+      {
+        TaskGroup tasks;
+        std::vector<DepthStatistics> depths;
+        for (PendingTree & tree : pending)
+        {
+          makeSubtree(std::move(tree.triangles), tree.slot, tasks, depths);
+        }
+        tasks.wait();
+        mergeStatistics(depths);
+      }
+
+      checkpoint_ = {};
+      statistics_.placedTriangles = (container_traits<I>::getSize(triangles_) + narrowTriangles_.size()) / 3;
+      layoutDepthFirst();
+      computeBounds();
+      statistics_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart_).count();
+    }
+
+    // create the bsp tree for the triangles given in the indices container into nodes_, it can be
+    // any container with container_traits, e.g. a view of the faces of a mesh, that is read once
+    // into the triangles of the build
+    template <class J>
+    void build(const J & indices, const std::function<void(Checkpoint &&)> & checkpoint = {})
+    {
+      Triangles triangles;
+      if constexpr (std::is_same_v<J, I>)
+      {
+        triangles.indices = indices;
+      }
+      else
+      {
+        container_traits<I>::resize(triangles.indices, container_traits<J>::getSize(indices));
+        for (size_type i = 0; i < container_traits<J>::getSize(indices); i++)
+        {
+          container_traits<I>::set(triangles.indices, i, get(indices, i));
+        }
+      }
+
+      // calculate the plane of every triangle once, split triangles keep it
+      triangles.planes.resize(container_traits<I>::getSize(triangles.indices) / 3);
+      std::for_each(EXECUTION_PAR triangles.planes.begin(), triangles.planes.end(),
+        [this, &triangleIndices = triangles.indices, first = triangles.planes.data()](Plane & plane)
+        {
+          const size_type t = size_type(&plane - first);
+          plane = calculatePlane(get(triangleIndices, 3*t), get(triangleIndices, 3*t+1), get(triangleIndices, 3*t+2));
+        }
+      );
+
+      pending_.push_back(PendingTree{ Slot{}, std::move(triangles) });
+      buildPending(checkpoint);
+    }
+
+    // the base vertex of the indices of node n, 0 when the tree is not narrow, region is the
+    // region of a node visited before, which mostly is the one of n as well, it is updated
+    std::uint32_t nodeBase(node_index n, size_type & region) const noexcept
+    {
+      if (regions_.empty()) return 0;
+      if (n < regions_[region].first || (region + 1 < regions_.size() && n >= regions_[region + 1].first))
+      {
+        region = size_type(std::ranges::upper_bound(regions_, n, {}, &Region::first) - regions_.begin()) - 1;
+      }
+      return regions_[region].base;
+    }
+
+    // the i-th index of the triangles on the plane of a node with the given base vertex
+    index_type nodeIndex(const Node & node, std::uint32_t base, size_type i) const noexcept
+    {
+      return regions_.empty() ? get(triangles_, node.first + i) : index_type(base + narrowTriangles_[node.first + i]);
+    }
+
+    // the i-th index of the triangles on the plane of node n
+    index_type nodeIndex(node_index n, size_type i) const noexcept
+    {
+      size_type region = 0;
+      return nodeIndex(nodes_[n], nodeBase(n, region), i);
+    }
+
+    // write the count indices of the triangles on the plane of a node with the given base vertex
+    // from the i-th on to out
+    template <class O>
+    void appendNodeIndices(const Node & node, std::uint32_t base, size_type i, size_type count, O & out) const
+    {
+      if (regions_.empty())
+      {
+        for (size_type k = node.first + i; k < node.first + i + count; k++)
+        {
+          *out++ = get(triangles_, k);
+        }
+        return;
+      }
+
+      for (size_type k = node.first + i; k < node.first + i + count; k++)
+      {
+        *out++ = index_type(base + narrowTriangles_[k]);
+      }
+    }
+
+    // the output of a sort that collects the ranges of the indices in node order to draw instead of
+    // writing the indices, ranges that follow each other are merged
+    struct RangeOutput
+    {
+      std::vector<DrawRange> & ranges;
+      const size_type * firsts;
+    };
+
+    // add the range of count indices of the triangles on the plane of a node from the i-th on to out
+    void appendNodeIndices(const Node & node, std::uint32_t base, size_type i, size_type count, RangeOutput & out) const
+    {
+      const size_type first = out.firsts[&node - nodes_.data()] + i;
+      if (!out.ranges.empty() && out.ranges.back().first + out.ranges.back().count == first && out.ranges.back().base == base)
+      {
+        out.ranges.back().count += count;
+      }
+      else
+      {
+        out.ranges.push_back(DrawRange{ first, count, base });
+      }
+    }
+
+    // sort the triangles of a leaf bucket into out by the distance of their centroid from p,
+    // the farthest first
+    template <class O>
+    void sortLeaf(const point_type & p, const Node & node, std::uint32_t base, O & out, LeafOrder & order) const
+    {
+      order.clear();
+      for (size_type i = 0; i < node.count; i += 3)
+      {
+        // 3 times the vector from p to the centroid, the factor does not change the order
+        const point_type c = (vertex_traits<vertex_type>::getPosition(get(vertices_, nodeIndex(node, base, i  ))) - p)
+                           + (vertex_traits<vertex_type>::getPosition(get(vertices_, nodeIndex(node, base, i+1))) - p)
+                           + (vertex_traits<vertex_type>::getPosition(get(vertices_, nodeIndex(node, base, i+2))) - p);
+        order.emplace_back(point_traits<point_type>::dot(c, c), i);
+      }
+
+      std::sort(order.begin(), order.end(), [](const auto & a, const auto & b) { return a.first > b.first; });
+
+      for (const auto & [d, i] : order)
+      {
+        appendNodeIndices(node, base, i, 3, out);
+      }
+    }
+
+    // the view of a cluster from p, twice the index of the direction of clusterDirections closest to
+    // the direction from p to the cluster, plus 1 when looking against that direction
+    std::uint8_t clusterView(const point_type & p, const Node & node, std::uint32_t base) const
+    {
+      // the direction to the first vertex of the cluster, which is close enough for a small cluster
+      const point_type v = vertex_traits<vertex_type>::getPosition(get(vertices_, nodeIndex(node, base, 0))) - p;
+
+      size_type best = 0;
+      coord_type bestDot = 0;
+      for (size_type d = 0; d < clusterDirections.size(); d++)
+      {
+        coord_type dot = 0;
+        for (size_type axis = 0; axis < 3; axis++)
+        {
+          dot += coord_type(clusterDirections[d][axis]) * point_traits<point_type>::coordinate(v, axis);
+        }
+        if (std::abs(dot) > std::abs(bestDot))
+        {
+          best = d;
+          bestDot = dot;
+        }
+      }
+
+      return std::uint8_t(2 * best + ((bestDot < 0) ? 1 : 0));
+    }
+
+    // write the triangles of a cluster with the given orders to out in the order precomputed for
+    // the given view
+    template <class O>
+    void sortCluster(std::uint8_t view, const Node & node, std::uint32_t orders, std::uint32_t base, O & out) const
+    {
+      // looking against the direction, the farthest triangles come last in the order
+      const size_type count = node.count / 3;
+      const std::uint8_t * order = clusterOrders_.data() + orders + (view / 2) * count;
+      for (size_type k = 0; k < count; k++)
+      {
+        appendNodeIndices(node, base, 3 * size_type(order[(view % 2 == 0) ? k : count - 1 - k]), 3, out);
+      }
+    }
+
+    // the corner of a bounding box that is farthest along the normal of a plane, or farthest
+    // against it
+    static point_type corner(const Bounds & bounds, const Plane & plane, bool along) noexcept
+    {
+      std::array<coord_type, 3> c;
+      for (size_type axis = 0; axis < 3; axis++)
+      {
+        const bool positive = (point_traits<point_type>::coordinate(normal(plane), axis) >= 0);
+        c[axis] = point_traits<point_type>::coordinate((positive == along) ? bounds.upper : bounds.lower, axis);
+      }
+      return point_traits<point_type>::make(c[0], c[1], c[2]);
+    }
+
+    // whether a bounding box is completely behind one of the planes of a frustum
+    static bool outside(const Frustum & frustum, const Bounds & bounds) noexcept
+    {
+      return std::ranges::any_of(frustum, [&bounds](const Plane & plane) { return distance(plane, corner(bounds, plane, true)) < 0; });
+    }
+
+    // whether a bounding box is completely in front of all the planes of a frustum
+    static bool inside(const Frustum & frustum, const Bounds & bounds) noexcept
+    {
+      return std::ranges::all_of(frustum, [&bounds](const Plane & plane) { return distance(plane, corner(bounds, plane, false)) >= 0; });
+    }
+
+    // compute the bounding box of the subtree of every node, the children of a node come after it,
+    // so the boxes are gathered backwards, a node without triangles gets an empty box
+    void computeBounds()
+    {
+      bounds_.resize(nodes_.size());
+      size_type region = 0;
+      for (size_type n = nodes_.size(); n-- > 0;)
+      {
+        const Node & node = nodes_[n];
+        const std::uint32_t base = nodeBase(node_index(n), region);
+
+        std::array<coord_type, 3> lower, upper;
+        lower.fill(std::numeric_limits<coord_type>::max());
+        upper.fill(std::numeric_limits<coord_type>::lowest());
+        const auto extend = [&lower, &upper](const point_type & low, const point_type & high)
+          {
+            for (size_type axis = 0; axis < 3; axis++)
+            {
+              lower[axis] = std::min(lower[axis], point_traits<point_type>::coordinate(low, axis));
+              upper[axis] = std::max(upper[axis], point_traits<point_type>::coordinate(high, axis));
+            }
+          };
+
+        for (size_type i = 0; i < node.count; i++)
+        {
+          const point_type position = vertex_traits<vertex_type>::getPosition(get(vertices_, nodeIndex(node, base, i)));
+          extend(position, position);
+        }
+        if (node.behind != noNode) extend(bounds_[node.behind].lower, bounds_[node.behind].upper);
+        if (node.infront != noNode) extend(bounds_[node.infront].lower, bounds_[node.infront].upper);
+
+        bounds_[n].lower = point_traits<point_type>::make(lower[0], lower[1], lower[2]);
+        bounds_[n].upper = point_traits<point_type>::make(upper[0], upper[1], upper[2]);
+      }
+    }
+
+    // sort the triangles of the subtree of node root into out so that triangles far from p are
+    // written first, the nodes are walked with an explicit stack, the far side first, then the node,
+    // then the near side, the side of p of every plane and the view of every cluster go to views,
+    // the subtrees whose bounding box is outside of the frustum, when there is one, are skipped,
+    // return the number of indices written
+    template <class O>
+    size_type sortBackToFront(const point_type & p, node_index root, O & out, SortScratch & scratch, std::uint8_t * views = nullptr,
+                              const Frustum * frustum = nullptr) const
+    {
+      size_type written = 0;
+      size_type region = 0;
+      auto & stack = scratch.stack;
+      stack.clear();
+      if (root != noNode) stack.emplace_back(root, false);
+
+      while (!stack.empty())
+      {
+        const auto [n, own] = stack.back();
+        stack.pop_back();
+
+        const Node & node = nodes_[n];
+        const std::uint32_t leaf = leafOf(n);
+        if (own)
+        {
+          appendNodeIndices(node, nodeBase(n, region), 0, node.count, out);
+          written += node.count;
+        }
+        else if (frustum && outside(*frustum, bounds_[n]))
+        {
+          continue;
+        }
+        else if (leaf != notLeaf && leaf != noOrders)
+        {
+          const std::uint32_t base = nodeBase(n, region);
+          const std::uint8_t view = clusterView(p, node, base);
+          if (views) views[n] = view;
+          sortCluster(view, node, leaf, base, out);
+          written += node.count;
+        }
+        else if (leaf == noOrders)
+        {
+          sortLeaf(p, node, nodeBase(n, region), out, scratch.leafOrder);
+          written += node.count;
+        }
+        else
+        {
+          const bool infrontFirst = (distance(node.plane, p) < 0);
+          if (views) views[n] = infrontFirst ? 1 : 0;
+          const node_index first = infrontFirst ? node.infront : node.behind;
+          const node_index last = infrontFirst ? node.behind : node.infront;
+
+          // pushed in reverse, the side away from p is popped first
+          if (last != noNode) stack.emplace_back(last, false);
+          if (node.count > 0) stack.emplace_back(n, true);
+          if (first != noNode) stack.emplace_back(first, false);
+        }
+      }
+
+      return written;
+    }
+
+    // compile the built nodes for sorting: store them in depth first order, the root first and the
+    // subtree behind a node before the one in front of it, which is the order of a loaded tree, with
+    // the triangles and the orders of the nodes in the same order, so a sort mostly walks forward
+    // through memory, the tree is not narrow yet
+    void layoutDepthFirst()
+    {
+      std::vector<Node> nodes;
+      nodes.reserve(nodes_.size());
+      std::vector<std::uint32_t> leaves;
+      if (!leaves_.empty()) leaves.resize(nodes_.size(), notLeaf);
+      I triangles;
+      container_traits<I>::reserve(triangles, container_traits<I>::getSize(triangles_));
+      std::vector<std::uint8_t> clusterOrders;
+      clusterOrders.reserve(clusterOrders_.size());
+
+      // the nodes left to move, with their new parent and side
+      std::vector<std::tuple<node_index, node_index, bool>> stack;
+      if (!nodes_.empty()) stack.emplace_back(0, noNode, false);
+
+      while (!stack.empty())
+      {
+        const auto [n, parent, infront] = stack.back();
+        stack.pop_back();
+
+        const node_index node = node_index(nodes.size());
+        Node & moved = nodes.emplace_back(nodes_[n]);
+        moved.behind = noNode;
+        moved.infront = noNode;
+        if (parent != noNode) (infront ? nodes[parent].infront : nodes[parent].behind) = node;
+
+        moved.first = std::uint32_t(container_traits<I>::getSize(triangles));
+        container_traits<I>::append(triangles, triangles_, nodes_[n].first, moved.count);
+
+        const std::uint32_t leaf = leafOf(n);
+        if (leaf != notLeaf && leaf != noOrders)
+        {
+          leaves[node] = std::uint32_t(clusterOrders.size());
+          const auto orders = clusterOrders_.begin() + leaf;
+          clusterOrders.insert(clusterOrders.end(), orders, orders + clusterDirections.size() * moved.count / 3);
+        }
+        else if (leaf == noOrders)
+        {
+          leaves[node] = noOrders;
+        }
+
+        if (nodes_[n].infront != noNode) stack.emplace_back(nodes_[n].infront, node, true);
+        if (nodes_[n].behind != noNode) stack.emplace_back(nodes_[n].behind, node, false);
+      }
+
+      nodes_ = std::move(nodes);
+      triangles_ = std::move(triangles);
+      leaves_ = std::move(leaves);
+      clusterOrders_ = std::move(clusterOrders);
+    }
+
+    // number of indices up to which a subtree is sorted by a single task
+    static constexpr size_type sortGrain = size_type(1) << 15;
+
+    // make the state fit this tree, return false when it did not, so the buffer does not hold a
+    // sort made with the state yet
+    bool prepareState(SortState & state) const
+    {
+      if (state.views.size() == nodes_.size() && state.sizes.size() == nodes_.size()) return true;
+
+      // the subtree of a node comes after it, so the sizes are summed up backwards
+      state.sizes.assign(nodes_.size(), 0);
+      for (size_type n = nodes_.size(); n-- > 0;)
+      {
+        const Node & node = nodes_[n];
+        state.sizes[n] = node.count + ((node.behind != noNode) ? state.sizes[node.behind] : 0)
+                                    + ((node.infront != noNode) ? state.sizes[node.infront] : 0);
+      }
+      state.views.assign(nodes_.size(), 0);
+
+      state.firsts.resize(nodes_.size());
+      size_type first = 0;
+      for (size_type n = 0; n < nodes_.size(); n++)
+      {
+        state.firsts[n] = first;
+        first += nodes_[n].count;
+      }
+
+      return false;
+    }
+
+    // sort the subtree of node root into out, which points to the first index of the subtree, as
+    // the size of every subtree is known, its place in out is too: the top of the subtree is walked
+    // here and the subtrees of at most sortGrain indices are sorted by tasks into disjoint ranges
+    template <class O>
+    void sortSubtrees(const point_type & p, node_index root, O out, SortState & state, TaskGroup & tasks) const
+    {
+      size_type region = 0;
+      auto & stack = state.subtrees;
+      stack.clear();
+      stack.emplace_back(root, 0);
+
+      while (!stack.empty())
+      {
+        const auto [n, offset] = stack.back();
+        stack.pop_back();
+
+        const Node & node = nodes_[n];
+        if (leafOf(n) != notLeaf || state.sizes[n] <= sortGrain)
+        {
+          tasks.run([this, &p, n, subtree = out + offset, views = state.views.data()]()
+            {
+              // every thread keeps its scratch space, so sorting does not allocate
+              thread_local SortScratch scratch;
+              O o = subtree;
+              sortBackToFront(p, n, o, scratch, views);
+            });
+          continue;
+        }
+
+        const bool infrontFirst = (distance(node.plane, p) < 0);
+        state.views[n] = infrontFirst ? 1 : 0;
+
+        const node_index first = infrontFirst ? node.infront : node.behind;
+        const node_index last = infrontFirst ? node.behind : node.infront;
+        const size_type firstSize = (first != noNode) ? state.sizes[first] : 0;
+
+        O own = out + offset + firstSize;
+        appendNodeIndices(node, nodeBase(n, region), 0, node.count, own);
+
+        if (last != noNode) stack.emplace_back(last, offset + firstSize + node.count);
+        if (first != noNode) stack.emplace_back(first, offset);
+      }
+    }
+
+    // a tree that is not built, for derived trees that set the vertices and build or load it themselves
+    explicit BspTree(const BuildOptions & options) : options_(options) {}
+
+  public:
+
+    /// construct the tree, vertices are taken over, indices not
+    /// the tree is constructed in such a way that the least number
+    /// of triangles need to be split, if there is a way to build this
+    /// tree without splitting, it will be found, unless options limit
+    /// the number of candidate pivots that are scored
+    /// \param vertices, container with vertices, will be taken over and
+    ///        new vertices appended, when necessary
+    /// \param indices, container with indices into the vertices, each group of
+    ///        3 corresponds to one triangle, it can be of another type than the
+    ///        indices of the tree when it has container_traits, it is only read,
+    ///        once, into the triangles the build consumes
+    /// \param options, options to trade tree quality for build time
+    template <class J>
+    BspTree(C && vertices, const J & indices, const BuildOptions & options = {})
+      : vertices_(std::move(vertices)), options_(options)
+    {
+      build(indices);
+    }
+
+    /// another constructor that assumes that the vertices given are grouped in
+    /// triples that each represents one triangle
+    BspTree(C && vertices, const BuildOptions & options = {})
+      : vertices_(std::move(vertices)), options_(options)
+    {
+      I indices;
+
+      for (size_type i = 0; i < container_traits<C>::getSize(vertices_); i++)
+      {
+        container_traits<I>::append(indices, i);
+      }
+
+      build(indices);
+    }
+
+    /// get the vertex container
+    const C & getVertices() const noexcept { return vertices_; }
+
+    /// store the indices of all nodes as 16 bit offsets from a base vertex, which halves their size:
+    /// the vertices are first renumbered in the order the tree uses them, so that the vertices of a
+    /// subtree are close, then each largest subtree whose vertices are less than 65536 apart gets a
+    /// base vertex, and each node above them one of its own, for which its vertices are copied next
+    /// to each other when they are farther apart, the nodes must be laid out depth first
+    /// \return the number of regions of nodes with a base vertex, 0 when the tree stays as it is
+    ///         because a node has too many vertices
+    size_type narrowIndices()
+    {
+      static constexpr index_type noVertex = std::numeric_limits<index_type>::max();
+      static constexpr index_type span = std::numeric_limits<std::uint16_t>::max();
+      if (!regions_.empty() || nodes_.empty()) return regions_.size();
+
+      const size_type verticesSize = container_traits<C>::getSize(vertices_);
+
+      // number the vertices in the order of their first use by the nodes, depth first
+      std::vector<index_type> renumbered(verticesSize, noVertex);
+      index_type next = 0;
+      for (size_type k = 0; k < container_traits<I>::getSize(triangles_); k++)
+      {
+        index_type & vertex = renumbered[get(triangles_, k)];
+        if (vertex == noVertex) vertex = next++;
+      }
+      for (index_type & vertex : renumbered)
+      {
+        if (vertex == noVertex) vertex = next++;
+      }
+
+      // the lowest and highest vertex of the subtree of every node, the subtree of a node comes after it
+      std::vector<std::pair<index_type, index_type>> bounds(nodes_.size(), { noVertex, 0 });
+      const auto ownBounds = [this, &renumbered](const Node & node)
+        {
+          std::pair<index_type, index_type> own{ noVertex, 0 };
+          for (size_type k = node.first; k < node.first + node.count; k++)
+          {
+            own.first = std::min(own.first, renumbered[get(triangles_, k)]);
+            own.second = std::max(own.second, renumbered[get(triangles_, k)]);
+          }
+          return own;
+        };
+      for (size_type n = nodes_.size(); n-- > 0;)
+      {
+        const Node & node = nodes_[n];
+        bounds[n] = ownBounds(node);
+        for (const node_index child : { node.behind, node.infront })
+        {
+          if (child == noNode) continue;
+          bounds[n].first = std::min(bounds[n].first, bounds[child].first);
+          bounds[n].second = std::max(bounds[n].second, bounds[child].second);
+        }
+      }
+      const auto base = [](const std::pair<index_type, index_type> & b) { return std::uint32_t((b.first == noVertex) ? 0 : b.first); };
+      const auto fits = [](const std::pair<index_type, index_type> & b) { return b.first == noVertex || b.second - b.first <= span; };
+
+      // the regions, depth first, with the vertices copied for the nodes whose own vertices are too far apart
+      std::vector<Region> regions;
+      std::vector<std::pair<node_index, std::vector<index_type>>> copies;
+      index_type end = index_type(verticesSize);
+      std::vector<node_index> stack{ 0 };
+      while (!stack.empty())
+      {
+        const node_index n = stack.back();
+        stack.pop_back();
+
+        const Node & node = nodes_[n];
+        if (fits(bounds[n]))
+        {
+          regions.push_back(Region{ n, base(bounds[n]) });
+          continue;
+        }
+
+        const std::pair<index_type, index_type> own = ownBounds(node);
+        if (fits(own))
+        {
+          regions.push_back(Region{ n, base(own) });
+        }
+        else
+        {
+          std::vector<index_type> vertices;
+          for (size_type k = node.first; k < node.first + node.count; k++)
+          {
+            vertices.push_back(renumbered[get(triangles_, k)]);
+          }
+          std::ranges::sort(vertices);
+          vertices.erase(std::ranges::unique(vertices).begin(), vertices.end());
+          if (vertices.size() > size_type(span) + 1) return 0;
+
+          regions.push_back(Region{ n, std::uint32_t(end) });
+          end += index_type(vertices.size());
+          copies.emplace_back(n, std::move(vertices));
+        }
+
+        if (node.infront != noNode) stack.push_back(node.infront);
+        if (node.behind != noNode) stack.push_back(node.behind);
+      }
+
+      C vertices;
+      container_traits<C>::resize(vertices, end);
+      for (size_type v = 0; v < verticesSize; v++)
+      {
+        container_traits<C>::set(vertices, renumbered[v], get(vertices_, v));
+      }
+      index_type copy = index_type(verticesSize);
+      for (const auto & [n, copiedVertices] : copies)
+      {
+        for (const index_type vertex : copiedVertices)
+        {
+          container_traits<C>::set(vertices, copy++, get(vertices, vertex));
+        }
+      }
+
+      // write the offsets of the indices of every node from the base vertex of its region
+      std::vector<std::uint16_t> narrowTriangles;
+      narrowTriangles.reserve(container_traits<I>::getSize(triangles_));
+      auto copied = copies.begin();
+      size_type region = 0;
+      for (size_type n = 0; n < nodes_.size(); n++)
+      {
+        Node & node = nodes_[n];
+        while (region + 1 < regions.size() && regions[region + 1].first <= n) region++;
+        const bool copiedNode = (copied != copies.end() && copied->first == n);
+
+        const std::uint32_t first = std::uint32_t(narrowTriangles.size());
+        for (size_type k = node.first; k < node.first + node.count; k++)
+        {
+          const index_type vertex = renumbered[get(triangles_, k)];
+          const index_type offset = copiedNode ? index_type(std::ranges::lower_bound(copied->second, vertex) - copied->second.begin())
+                                               : index_type(vertex - regions[region].base);
+          narrowTriangles.push_back(std::uint16_t(offset));
+        }
+        node.first = first;
+
+        if (copiedNode) ++copied;
+      }
+
+      vertices_ = std::move(vertices);
+      triangles_ = I();
+      narrowTriangles_ = std::move(narrowTriangles);
+      regions_ = std::move(regions);
+
+      return regions_.size();
+    }
+
+    /// get the statistics of the build of the tree
+    const BuildStatistics & getStatistics() const noexcept { return statistics_; }
+
+    /// get the number of indices that a sort writes, 3 for each triangle in the tree
+    size_type indexCount() const noexcept
+    {
+      return container_traits<I>::getSize(triangles_) + narrowTriangles_.size();
+    }
+
+    /// write the indices of the triangles sorted from back to front when viewed from the given
+    /// position to an output iterator, e.g. a pointer into a mapped index buffer, without allocating
+    /// \param p the point from where to look
+    /// \param out output iterator that takes indexCount() indices into the vertex container
+    /// \param scratch scratch space of the sort, it only allocates when it has to grow
+    /// \return the number of indices written
+    template <class O>
+    size_type sort(const point_type & p, O out, SortScratch & scratch) const
+    {
+      // TODO do we want to check, if the container elements are big enough?
+      sortBackToFront(p, nodes_.empty() ? noNode : 0, out, scratch);
+
+      return indexCount();
+    }
+
+    /// sort like above into a buffer that already holds the sort of a previous point of view made
+    /// with the same state, only the subtrees whose order changed are written again: the subtrees
+    /// of the planes that the point of view crossed, the clusters seen from another direction and
+    /// the leaf buckets, the first resort with a state writes everything
+    /// \param p the point from where to look
+    /// \param out random access iterator to the buffer of indexCount() indices, that keeps its content
+    /// \param state the state of the buffer, which belongs to this tree
+    /// \return the number of indices written
+    template <class O>
+    size_type resort(const point_type & p, O out, SortState & state) const
+    {
+      if (!prepareState(state)) return sort(p, out, state);
+
+      size_type written = 0;
+      size_type region = 0;
+      TaskGroup tasks;
+      auto & stack = state.stack;
+      stack.clear();
+      if (!nodes_.empty()) stack.emplace_back(0, 0);
+
+      while (!stack.empty())
+      {
+        const auto [n, offset] = stack.back();
+        stack.pop_back();
+
+        const Node & node = nodes_[n];
+        O subtree = out + offset;
+        const std::uint32_t leaf = leafOf(n);
+        if (leaf != notLeaf && leaf != noOrders)
+        {
+          const std::uint32_t base = nodeBase(n, region);
+          const std::uint8_t view = clusterView(p, node, base);
+          if (view == state.views[n]) continue;
+
+          state.views[n] = view;
+          sortCluster(view, node, leaf, base, subtree);
+          written += node.count;
+        }
+        else if (leaf == noOrders)
+        {
+          // the order of a leaf bucket changes with every move
+          sortLeaf(p, node, nodeBase(n, region), subtree, state.scratch.leafOrder);
+          written += node.count;
+        }
+        else if ((distance(node.plane, p) < 0 ? 1 : 0) != state.views[n])
+        {
+          // the point of view crossed the plane, the whole subtree is written in its new order
+          sortSubtrees(p, n, subtree, state, tasks);
+          written += state.sizes[n];
+        }
+        else
+        {
+          // same order as before, only the subtrees below can have changed
+          const node_index first = state.views[n] ? node.infront : node.behind;
+          const node_index last = state.views[n] ? node.behind : node.infront;
+          if (last != noNode) stack.emplace_back(last, offset + ((first != noNode) ? state.sizes[first] : 0) + node.count);
+          if (first != noNode) stack.emplace_back(first, offset);
+        }
+      }
+      tasks.wait();
+
+      return written;
+    }
+
+    /// sort like above with several threads, which write disjoint ranges of the buffer, and
+    /// remember the sort in the state, so the buffer can be resorted
+    /// \param p the point from where to look
+    /// \param out random access iterator to the buffer of indexCount() indices
+    /// \param state the state of the buffer, which belongs to this tree
+    /// \return the number of indices written
+    template <class O>
+    size_type sort(const point_type & p, O out, SortState & state) const
+    {
+      prepareState(state);
+      if (nodes_.empty()) return 0;
+
+      TaskGroup tasks;
+      sortSubtrees(p, 0, out, state, tasks);
+      tasks.wait();
+
+      return indexCount();
+    }
+
+    /// write the indices of all nodes in the order of the nodes, which does not depend on the point
+    /// of view, e.g. into a static index buffer that is drawn by the ranges of sortRanges
+    /// \param out output iterator that takes indexCount() indices into the vertex container
+    /// \return the number of indices written
+    template <class O>
+    size_type nodeOrderIndices(O out) const
+    {
+      size_type region = 0;
+      for (size_type n = 0; n < nodes_.size(); n++)
+      {
+        appendNodeIndices(nodes_[n], nodeBase(node_index(n), region), 0, nodes_[n].count, out);
+      }
+      return indexCount();
+    }
+
+    /// whether the indices of the nodes are stored as 16 bit offsets, see narrowIndices
+    bool narrow() const noexcept { return !regions_.empty(); }
+
+    /// write the indices of all nodes of a narrow tree in the order of the nodes like nodeOrderIndices,
+    /// but as the 16 bit offsets from the base vertex of the ranges of sortRanges that draw them
+    /// \param out output iterator that takes indexCount() 16 bit indices
+    /// \return the number of indices written
+    template <class O>
+    size_type nodeOrderOffsets(O out) const
+    {
+      std::ranges::copy(narrowTriangles_, out);
+      return narrowTriangles_.size();
+    }
+
+    /// sort the triangles from back to front when viewed from the given position as ranges of the
+    /// indices of nodeOrderIndices, e.g. to draw them with glMultiDrawElements, the triangles of the
+    /// nodes come as one range but the triangles of leaf buckets and clusters as one range each
+    /// unless they follow each other, the ranges of a narrow tree are drawn from nodeOrderOffsets
+    /// with their base vertex, e.g. with glMultiDrawElementsBaseVertex
+    /// \param p the point from where to look
+    /// \param ranges the ranges to draw in that order, it only allocates when it has to grow
+    /// \param state the state of the ranges, which belongs to this tree
+    /// \param frustum when given, the subtrees whose bounding box is outside of it are left out
+    /// \return the number of ranges
+    size_type sortRanges(const point_type & p, std::vector<DrawRange> & ranges, SortState & state, const Frustum * frustum = nullptr) const
+    {
+      prepareState(state);
+      ranges.clear();
+
+      RangeOutput out{ ranges, state.firsts.data() };
+      sortBackToFront(p, nodes_.empty() ? noNode : 0, out, state.scratch, nullptr, frustum);
+
+      return ranges.size();
+    }
+
+    /// sort into a buffer like resort, but leave out the subtrees whose bounding box is outside of
+    /// the view frustum, the visible triangles come first in the buffer: while the whole tree is
+    /// visible it is a resort, otherwise the visible triangles are all written and the next resort
+    /// writes everything again
+    /// \param p the point from where to look
+    /// \param frustum the view frustum
+    /// \param out random access iterator to the buffer of indexCount() indices
+    /// \param state the state of the buffer, which belongs to this tree
+    /// \return the number of indices to draw from the start of the buffer
+    template <class O>
+    size_type sortVisible(const point_type & p, const Frustum & frustum, O out, SortState & state) const
+    {
+      if (nodes_.empty()) return 0;
+
+      if (inside(frustum, bounds_[0]))
+      {
+        resort(p, out, state);
+        return indexCount();
+      }
+
+      // the buffer no longer holds the sort of the state
+      state.views.clear();
+      return sortBackToFront(p, 0, out, state.scratch, nullptr, &frustum);
+    }
+
+    /// the same with its own scratch space
+    template <class O>
+    size_type sort(const point_type & p, O out) const
+    {
+      SortScratch scratch;
+      return sort(p, out, scratch);
+    }
+
+    /// get a container of indices for triangles so that the triangles are sorted
+    /// from back to front when viewed from the given position
+    /// \param p the point from where to look
+    /// \return container of indices into the vertex container
+    I sort(const point_type & p) const
+    {
+      I out;
+      container_traits<I>::resize(out, indexCount());
+      sort(p, std::begin(out));
 
       return out;
     }